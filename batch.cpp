@@ -0,0 +1,127 @@
+// $Id: batch.cpp,v 1.1 2016-03-19 14:02:10-07 - - $
+// Partner: Darius Sakhapour(dsakhapo@ucsc.edu)
+// Partner: Ryan Wong (rystwong@ucsc.edu)
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+#include "batch.h"
+#include "debug.h"
+#include "trace.h"
+
+//        *********************************************
+//        ************ Batch Output Buffer ************
+//        *********************************************
+
+batch_buffer::batch_buffer (int fd_, size_t threshold_):
+              fd (fd_), threshold (threshold_) {
+   buffer.reserve (threshold + threshold / 4);
+}
+
+batch_buffer::~batch_buffer() {
+   flush_all();
+}
+
+// Writes the whole buffer, retrying short writes and interrupts.
+bool batch_buffer::write_all() {
+   const char* next = buffer.data();
+   size_t left = buffer.size();
+   while (left > 0) {
+      ssize_t written = ::write (fd, next, left);
+      if (written < 0) {
+         if (errno == EINTR) continue;
+         buffer.clear();
+         return false;
+      }
+      next += written;
+      left -= written;
+   }
+   TRACE ('b', "wrote % bytes", buffer.size());
+   buffer.clear();
+   return true;
+}
+
+bool batch_buffer::flush_all() {
+   return write_all();
+}
+
+batch_buffer::int_type batch_buffer::overflow (int_type ch) {
+   if (traits_type::eq_int_type (ch, traits_type::eof())) {
+      return traits_type::not_eof (ch);
+   }
+   buffer.push_back (traits_type::to_char_type (ch));
+   if (buffer.size() >= threshold and not write_all()) {
+      return traits_type::eof();
+   }
+   return ch;
+}
+
+streamsize batch_buffer::xsputn (const char* str, streamsize count) {
+   buffer.insert (buffer.end(), str, str + count);
+   if (buffer.size() >= threshold and not write_all()) return 0;
+   return count;
+}
+
+// Called for endl and flush.  Only writes once past the threshold.
+int batch_buffer::sync() {
+   if (buffer.size() < threshold) return 0;
+   return write_all() ? 0 : -1;
+}
+
+//        *********************************************
+//        **************** Script Input ***************
+//        *********************************************
+
+script_input::script_input (int fd) {
+   struct stat info;
+   if (fstat (fd, &info) == 0 and S_ISREG (info.st_mode)
+       and info.st_size > 0) {
+      void* addr = mmap (nullptr, info.st_size, PROT_READ,
+                         MAP_PRIVATE, fd, 0);
+      if (addr != MAP_FAILED) {
+         madvise (addr, info.st_size, MADV_SEQUENTIAL);
+         text = static_cast<const char*> (addr);
+         length = info.st_size;
+         mapped = true;
+         DEBUGF ('b', "mapped " << length << " bytes");
+         return;
+      }
+   }
+   constexpr size_t chunk_size = 1 << 20;
+   for (;;) {
+      size_t used = chunks.size();
+      chunks.resize (used + chunk_size);
+      ssize_t got = ::read (fd, &chunks[used], chunk_size);
+      if (got < 0 and errno == EINTR) {
+         chunks.resize (used);
+         continue;
+      }
+      chunks.resize (used + (got > 0 ? got : 0));
+      if (got <= 0) break;
+   }
+   text = chunks.data();
+   length = chunks.size();
+   DEBUGF ('b', "read " << length << " bytes");
+}
+
+script_input::~script_input() {
+   if (mapped) munmap (const_cast<char*> (text), length);
+}
+
+bool script_input::next_line (string& line) {
+   if (position >= length) return false;
+   const char* start = text + position;
+   const void* newline = memchr (start, '\n', length - position);
+   if (newline == nullptr) return false;
+   const char* end = static_cast<const char*> (newline);
+   line.assign (start, end);
+   position += end - start + 1;
+   return true;
+}
+
@@ -0,0 +1,67 @@
+// $Id: batch.h,v 1.1 2016-03-19 14:02:10-07 - - $
+// Partner: Darius Sakhapour(dsakhapo@ucsc.edu)
+// Partner: Ryan Wong (rystwong@ucsc.edu)
+
+#ifndef __BATCH_H__
+#define __BATCH_H__
+
+#include <cstddef>
+#include <streambuf>
+#include <string>
+#include <vector>
+using namespace std;
+
+// batch_buffer -
+//    An output streambuf for batch mode.  Everything written to it
+//    is collected in one large buffer which is written to the file
+//    descriptor only when it passes the threshold, or when flush_all
+//    is called.  A flush requested by endl does not force a write,
+//    so a script costs one write(2) per threshold's worth of output
+//    instead of one per line.
+
+class batch_buffer: public streambuf {
+   private:
+      int fd;
+      size_t threshold;
+      vector<char> buffer;
+      bool write_all();
+   protected:
+      virtual int_type overflow (int_type ch) override;
+      virtual streamsize xsputn (const char* str,
+                                 streamsize count) override;
+      virtual int sync() override;
+   public:
+      explicit batch_buffer (int fd, size_t threshold = 1 << 20);
+      ~batch_buffer();
+      batch_buffer (const batch_buffer&) = delete;
+      batch_buffer& operator= (const batch_buffer&) = delete;
+      bool flush_all();
+};
+
+// script_input -
+//    The entire text of a script, read from a file descriptor.  A
+//    regular file is mapped with mmap; anything else (a pipe or a
+//    terminal) is read in large chunks.
+// next_line -
+//    Sets line to the next newline-terminated line and returns
+//    true.  Returns false at end of input.  As with getline at end
+//    of file, a final line with no newline is treated as end of
+//    input.
+
+class script_input {
+   private:
+      const char* text {nullptr};
+      size_t length {0};
+      size_t position {0};
+      bool mapped {false};
+      string chunks;
+   public:
+      explicit script_input (int fd);
+      ~script_input();
+      script_input (const script_input&) = delete;
+      script_input& operator= (const script_input&) = delete;
+      bool next_line (string& line);
+};
+
+#endif
+
@@ -0,0 +1,1333 @@
+// $Id: benchmark.cpp,v 1.1 2016-03-19 14:02:10-07 - - $
+// Partner: Darius Sakhapour(dsakhapo@ucsc.edu)
+// Partner: Ryan Wong (rystwong@ucsc.edu)
+
+// benchmark -
+//    Standalone timing driver for the simulated file system.  It is
+//    linked against every object of yshell except main.o, and drives
+//    the command functions directly.  The workload sections also run
+//    their generated scripts through the yshell binary, to time the
+//    full REPL, and the server section runs it as a server and as
+//    its clients.  make benchmark builds it beside yshell.
+//    Usage:  benchmark [-o file] [-n scale] [-s seed] [-y yshell]
+//                      [section...]
+//    With no sections, every section is run.
+//    -o file   also write every result to file as JSON lines, one
+//              object per measurement, for comparing builds.
+//    -n scale  multiply the size of the generated workloads.
+//    -s seed   seed for the mixed workload.
+//    -y yshell the binary for the REPL runs, by default the yshell
+//              beside this benchmark.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <random>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <csignal>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+using namespace std;
+
+#include "commands.h"
+#include "file_sys.h"
+#include "journal.h"
+#include "pool.h"
+#include "trace.h"
+#include "util.h"
+
+using bench_clock = chrono::steady_clock;
+
+// Every call to the global operator new is counted, so sections can
+// report heap allocations per operation.  The replacements are all
+// kept out of line, so GCC never sees the malloc in one inlined into
+// the same function as the free in another and warns about a
+// mismatched deallocation.
+static atomic<size_t> heap_allocations {0};
+static atomic<size_t> heap_bytes {0};
+
+[[gnu::noinline]] void* operator new (size_t size) {
+   ++heap_allocations;
+   heap_bytes += size;
+   void* block = malloc (size == 0 ? 1 : size);
+   if (block == nullptr) throw bad_alloc();
+   return block;
+}
+
+[[gnu::noinline]] void operator delete (void* block) noexcept {
+   free (block);
+}
+
+[[gnu::noinline]] void operator delete (void* block, size_t) noexcept {
+   free (block);
+}
+
+// Output of the commands themselves goes here while being timed.
+static ofstream null_out ("/dev/null");
+
+// The words of a command line written out in place, as in
+//    fn_mkdir (state, args {"mkdir", path});
+// They are views, so strings built in the list must outlive the call,
+// which temporaries do.
+using args = vector<string_view>;
+
+// time_per_op -
+//    Calls fn reps times with cout discarded and returns the mean
+//    number of nanoseconds per call.
+
+template <typename func_t>
+static double time_per_op (size_t reps, func_t fn) {
+   streambuf* saved = cout.rdbuf (null_out.rdbuf());
+   auto start = bench_clock::now();
+   for (size_t rep = 0; rep < reps; ++rep) fn (rep);
+   auto stop = bench_clock::now();
+   cout.rdbuf (saved);
+   chrono::duration<double,nano> elapsed = stop - start;
+   return elapsed.count() / reps;
+}
+
+// result -
+//    One measurement, kept for the JSON lines written by -o.
+
+struct result {
+   string section;
+   string metric;
+   double value;
+   string unit;
+};
+static vector<result> results;
+
+static void record (const string& section, const string& metric,
+                    double value, const string& unit) {
+   results.push_back ({section, metric, value, unit});
+}
+
+static void report (const string& section, const string& what,
+                    double ns) {
+   cout << left << setw (10) << section << setw (30) << what
+        << right << setw (14) << fixed << setprecision (1) << ns
+        << " ns/op" << endl;
+   record (section, what, ns, "ns/op");
+}
+
+// Writes a string as a JSON string literal.
+static void write_json_string (ostream& out, const string& text) {
+   out << '"';
+   for (char ch: text) {
+      if (ch == '"' or ch == '\\') out << '\\' << ch;
+      else if (static_cast<unsigned char> (ch) < 0x20) {
+         out << "\\u" << hex << setw (4) << setfill ('0')
+             << static_cast<int> (ch) << dec << setfill (' ');
+      }else out << ch;
+   }
+   out << '"';
+}
+
+static void write_results (const string& filename) {
+   ofstream out (filename);
+   for (const result& each: results) {
+      out << "{\"build\": ";
+      write_json_string (out, __DATE__ " " __TIME__);
+      out << ", \"section\": ";
+      write_json_string (out, each.section);
+      out << ", \"metric\": ";
+      write_json_string (out, each.metric);
+      out << ", \"value\": " << setprecision (6) << defaultfloat
+          << each.value << ", \"unit\": ";
+      write_json_string (out, each.unit);
+      out << "}\n";
+   }
+   if (not out) complain() << filename << ": cannot write" << endl;
+}
+
+// bench_dispatch -
+//    Looking up a command by name in the compile time perfect hash,
+//    for every command in turn and for an unknown one, against an
+//    unordered_map built at run time, as the table used to be.
+
+static void bench_dispatch() {
+   vector<string_view> names;
+   unordered_map<string,command_info> old_table;
+   for (const command_entry& entry: command_names()) {
+      names.push_back (entry.name);
+      old_table.emplace (string (entry.name), entry.info);
+   }
+   size_t found = 0;
+   report ("dispatch", "perfect hash", time_per_op (10000000,
+      [&] (size_t i) {
+         found += find_command (names[i % names.size()]).mutates;
+      }));
+   report ("dispatch", "perfect hash, unknown", time_per_op (1000000,
+      [&] (size_t) {
+         try {
+            find_command ("remove");
+         }catch (command_error&) {
+            ++found;
+         }
+      }));
+   report ("dispatch", "unordered_map (old)", time_per_op (10000000,
+      [&] (size_t i) {
+         found += old_table.find (string (names[i % names.size()]))
+                  ->second.mutates;
+      }));
+   if (found == 0) cout << "dispatch  nothing found" << endl;
+}
+
+// bench_dirents -
+//    Per-call cost of commands in a directory of 100k entries,
+//    against the cost of the map copy every command used to make.
+
+static void bench_dirents() {
+   constexpr size_t entries = 100000;
+   inode_state state;
+   time_per_op (entries, [&] (size_t i) {
+      fn_make (state, args {"make", "f" + to_string (i), "some", "words"});
+   });
+   const base_file_ptr& cwd = state.get_cwd()->get_contents();
+   report ("dirents", "make (overwrite)", time_per_op (10000,
+      [&] (size_t) { fn_make (state, args {"make", "f50000", "x", "y"}); }));
+   report ("dirents", "cat", time_per_op (10000,
+      [&] (size_t) { fn_cat (state, args {"cat", "f50000"}); }));
+   report ("dirents", "mkdir", time_per_op (10000,
+      [&] (size_t i) { fn_mkdir (state, args {"mkdir", "d" + to_string (i)});
+   }));
+   report ("dirents", "rm", time_per_op (10000,
+      [&] (size_t i) { fn_rm (state, args {"rm", "d" + to_string (i)}); }));
+   report ("dirents", "copy of dirent map (old)", time_per_op (20,
+      [&] (size_t) { dirent_table copy = cwd->get_dirents(); }));
+}
+
+// bench_pwd -
+//    pwd in a directory 1000 levels deep, whose ancestors each hold
+//    100 files.  Only the first pwd after a cd walks up the tree.
+
+static void bench_pwd() {
+   inode_state state;
+   for (size_t level = 0; level < 1000; ++level) {
+      fn_mkdir (state, args {"mkdir", "level" + to_string (level)});
+      fn_cd (state, args {"cd", "level" + to_string (level)});
+      for (size_t file = 0; file < 100; ++file) {
+         fn_make (state, args {"make", "f" + to_string (file)});
+      }
+   }
+   report ("pwd", "pwd at depth 1000", time_per_op (100000,
+      [&] (size_t) { fn_pwd (state, args {"pwd"}); }));
+   report ("pwd", "cd . then pwd at depth 1000", time_per_op (1000,
+      [&] (size_t) {
+         fn_cd (state, args {"cd", "."});
+         fn_pwd (state, args {"pwd"});
+      }));
+}
+
+// bench_trace -
+//    The cost of one trace with its flag off, recorded by TRACE, and
+//    printed by DEBUGF into a discarded stream.  Flag 'T' is used by
+//    nothing else, so it can be turned on here.
+
+static void bench_trace() {
+   report ("trace", "TRACE, flag off", time_per_op (10000000,
+      [] (size_t op) { TRACE ('T', "op %", op); }));
+   debugflags::setflags ("T");
+   report ("trace", "TRACE, flag on", time_per_op (10000000,
+      [] (size_t op) { TRACE ('T', "op %", op); }));
+   report ("trace", "TRACE with a string, flag on", time_per_op (10000000,
+      [] (size_t op) { TRACE ('T', "op % %", op, "a name"); }));
+   streambuf* saved_out = cout.rdbuf (null_out.rdbuf());
+   streambuf* saved_err = cerr.rdbuf (null_out.rdbuf());
+   double debugf_ns = time_per_op (1000000,
+      [] (size_t op) { DEBUGF ('T', "op " << op); });
+   trace::dump (cerr);
+   cerr.rdbuf (saved_err);
+   cout.rdbuf (saved_out);
+   report ("trace", "DEBUGF, flag on", debugf_ns);
+}
+
+// bench_reclaim -
+//    Builds and removes scratch trees repeatedly, checking with the
+//    live inode counter that every removed inode was freed, and with
+//    the name table that their names were freed with them.
+
+static void bench_reclaim() {
+   constexpr size_t rounds = 100;
+   inode_state state;
+   size_t before = inode::live_count();
+   size_t names_before = name_table::count();
+   double ns = time_per_op (rounds, [&] (size_t) {
+      fn_mkdir (state, args {"mkdir", "scratch"});
+      for (size_t dir = 0; dir < 10; ++dir) {
+         string path = "scratch/d" + to_string (dir);
+         fn_mkdir (state, args {"mkdir", path});
+         for (size_t file = 0; file < 100; ++file) {
+            fn_make (state, args {"make", path + "/f" + to_string (file)});
+         }
+      }
+      fn_rmr (state, args {"rmr", "scratch"});
+   });
+   report ("reclaim", "build+rmr 1011 inodes", ns);
+   cout << "reclaim   live inodes before " << before << ", after "
+        << inode::live_count() << endl;
+   cout << "reclaim   names before " << names_before << ", after "
+        << name_table::count() << endl;
+}
+
+// bench_append -
+//    Grows a log file one five-word line at a time.  The cost per
+//    append should stay flat as the file grows.
+
+static void bench_append() {
+   inode_state state;
+   vector<string_view> line {"append", "log", "one", "two", "three",
+                             "four", "five"};
+   for (size_t round = 1; round <= 4; ++round) {
+      double ns = time_per_op (100000,
+         [&] (size_t) { fn_append (state, line); });
+      report ("append", "line, file at " + to_string (round * 100)
+              + "k lines", ns);
+   }
+}
+
+// bench_cat -
+//    A file of 1M words:  heap bytes per word while building it, and
+//    the time to cat it.
+
+static void bench_cat() {
+   constexpr size_t words = 1000000;
+   inode_state state;
+   wordvec text {"append", "big"};
+   for (size_t word = 0; word < 1000; ++word) {
+      text.push_back ("word" + to_string (word));
+   }
+   vector<string_view> line (text.begin(), text.end());
+   size_t bytes_before = heap_bytes;
+   for (size_t round = 0; round < words / 1000; ++round) {
+      fn_append (state, line);
+   }
+   cout << "cat       heap bytes per word "
+        << (heap_bytes - bytes_before) / words << endl;
+   report ("cat", "1M word file", time_per_op (20,
+      [&] (size_t) { fn_cat (state, args {"cat", "big"}); }));
+}
+
+// bench_dentry -
+//    Repeated commands on one deep path, through a tree whose levels
+//    each hold 1000 files, with the dentry cache on and off.  Every
+//    mkdir and rm in the loop changes the directory at the bottom of
+//    the path, so half the lookups there have to walk again.
+
+static void bench_dentry() {
+   inode_state state;
+   string path = "";
+   for (const char* level: {"a", "b", "c", "d", "e", "f", "g", "h"}) {
+      path += level;
+      fn_mkdir (state, args {"mkdir", path});
+      for (size_t file = 0; file < 1000; ++file) {
+         fn_make (state, args {"make", path + "/f" + to_string (file)});
+      }
+      path += "/";
+   }
+   string file = path + "f500";
+   for (size_t capacity: {65536, 0}) {
+      dentry_cache& dentries = state.get_dentries();
+      dentries.set_capacity (capacity);
+      string label = capacity == 0 ? " (no cache)" : " (cached)";
+      report ("dentry", "cd a/.../h" + label, time_per_op (100000,
+         [&] (size_t) {
+            fn_cd (state, args {"cd", path});
+            fn_cd (state, args {"cd", "/"});
+         }) / 2);
+      report ("dentry", "make a/.../h/f500" + label, time_per_op (100000,
+         [&] (size_t) { fn_make (state, args {"make", file, "x"}); }));
+      report ("dentry", "cat a/.../h/f500" + label, time_per_op (100000,
+         [&] (size_t) { fn_cat (state, args {"cat", file}); }));
+      report ("dentry", "mkdir+rm a/.../h/new" + label, time_per_op (
+         100000, [&] (size_t) {
+            fn_mkdir (state, args {"mkdir", path + "new"});
+            fn_rm (state, args {"rm", path + "new"});
+         }) / 2);
+      if (capacity != 0) dentries.report (cout);
+   }
+}
+
+// bench_build -
+//    Tree construction through the directory API:  100 directories
+//    of 1000 files each, reporting time, heap allocations and pool
+//    blocks per created inode.
+
+static void bench_build() {
+   constexpr size_t dirs = 100;
+   constexpr size_t files = 1000;
+   inode_state state;
+   const base_file_ptr& root = state.get_root()->get_contents();
+   size_t heap_before = heap_allocations;
+   size_t blocks_before = pool_stats::allocated;
+   double ns = time_per_op (dirs, [&] (size_t dir) {
+      inode_ptr sub = root->mkdir ("d" + to_string (dir));
+      const base_file_ptr& contents = sub->get_contents();
+      for (size_t file = 0; file < files; ++file) {
+         contents->mkfile ("f" + to_string (file));
+      }
+   });
+   double created = dirs * (files + 1);
+   report ("build", "create inode", ns / (files + 1));
+   cout << setprecision (3) << "build     heap allocations per inode "
+        << (heap_allocations - heap_before) / created
+        << ", pool blocks per inode "
+        << (pool_stats::allocated - blocks_before) / created
+        << ", slabs " << pool_stats::slabs << endl;
+}
+
+// bench_snapshot -
+//    Saves and loads a tree of 1000 directories of 1000 two-word
+//    files, about 1M inodes, through a snapshot in /tmp.  Then checks
+//    that files with quoted words holding blanks, empty words, and no
+//    words at all come back from a snapshot unchanged.
+
+static void bench_snapshot() {
+   constexpr size_t dirs = 1000;
+   constexpr size_t files = 1000;
+   string filename = "/tmp/benchmark." + to_string (getpid()) + ".snap";
+   inode_state state;
+   const base_file_ptr& root = state.get_root()->get_contents();
+   for (size_t dir = 0; dir < dirs; ++dir) {
+      inode_ptr sub = root->mkdir ("d" + to_string (dir));
+      for (size_t file = 0; file < files; ++file) {
+         inode_ptr node = sub->get_contents()->mkfile ("f"
+                        + to_string (file));
+         node->get_contents()->set_data ({"some", "words"});
+      }
+   }
+   double inodes = dirs * (files + 1) + 1;
+   double save_ns = time_per_op (1,
+      [&] (size_t) { state.save_snapshot (filename); });
+   report ("snapshot", "save, per inode", save_ns / inodes);
+   double load_ns = time_per_op (1,
+      [&] (size_t) { state.load_snapshot (filename); });
+   report ("snapshot", "load, per inode", load_ns / inodes);
+   ifstream saved (filename, ios::binary | ios::ate);
+   cout << "snapshot  " << static_cast<size_t> (inodes) << " inodes, "
+        << fixed << setprecision (1) << saved.tellg() / inodes
+        << " bytes per inode, load "
+        << setprecision (2) << load_ns / 1e9 << " s" << endl;
+
+   inode_state quoted;
+   fn_make (quoted, args {"make", "q", "a  b", "", "c", " "});
+   fn_make (quoted, args {"make", "e"});
+   auto words_of = [&quoted] (const string& name) {
+      return quoted.get_root()->get_contents()->lookup (name, false)
+                   ->get_contents()->readfile();
+   };
+   wordvec q_before = words_of ("q");
+   wordvec e_before = words_of ("e");
+   quoted.save_snapshot (filename);
+   quoted.load_snapshot (filename);
+   if (words_of ("q") != q_before or words_of ("e") != e_before) {
+      complain() << "snapshot: quoted words changed by save and load"
+                 << endl;
+   }else {
+      cout << "snapshot  quoted and empty words survive save and load"
+           << endl;
+   }
+   unlink (filename.c_str());
+}
+
+// bench_split -
+//    Splitting a command line and its pathname into strings, as
+//    split does, and into views, as split_words and split_views do,
+//    with the heap bytes each takes per line.
+
+static void bench_split() {
+   string line = "make /usr/local/share/doc/notes some words to put in it";
+   size_t bytes_before = heap_bytes;
+   double ns = time_per_op (1000000, [&] (size_t) {
+      wordvec words = split (line, " \t");
+      wordvec components = split (words[1], "/");
+   });
+   report ("split", "split into strings", ns);
+   cout << "split     heap bytes per line "
+        << (heap_bytes - bytes_before) / 1000000 << endl;
+   vector<string_view> words;
+   vector<string_view> components;
+   bytes_before = heap_bytes;
+   ns = time_per_op (1000000, [&] (size_t) {
+      split_words (line, words);
+      split_views (words[1], slashes, components);
+   });
+   report ("split", "split_words into views", ns);
+   cout << "split     heap bytes per line "
+        << (heap_bytes - bytes_before) / 1000000 << endl;
+}
+
+// bench_table -
+//    Microbenchmark of dirent_table insert, lookup and iteration at
+//    10, 1k and 1M entries, against the std::map<string,inode_ptr>
+//    directories used to be.  Names are interned before timing.
+
+static void bench_table() {
+   inode_ptr node = new_inode (file_type::PLAIN_TYPE);
+   for (size_t entries: {10, 1000, 1000000}) {
+      vector<string> names;
+      vector<name_ref> refs;
+      for (size_t i = 0; i < entries; ++i) {
+         names.push_back ("entry" + to_string (i * 7919 % entries));
+         refs.push_back (name_table::intern (names.back()));
+      }
+      size_t reps = 10000000 / entries;
+      string size = to_string (entries);
+      size_t sum = 0;
+      report ("table", "insert " + size, time_per_op (reps,
+         [&] (size_t) {
+            dirent_table table;
+            for (name_ref ref: refs) table.insert (ref, false, node);
+         }) / entries);
+      dirent_table table;
+      for (name_ref ref: refs) table.insert (ref, false, node);
+      report ("table", "lookup " + size, time_per_op (entries * 10,
+         [&] (size_t i) {
+            sum += table.find (refs[i % entries], false) != nullptr;
+         }));
+      report ("table", "iterate " + size, time_per_op (reps,
+         [&] (size_t) {
+            for (const dirent& entry: table) sum += entry.name->size();
+         }) / entries);
+      report ("table", "map insert " + size, time_per_op (reps,
+         [&] (size_t) {
+            map<string,inode_ptr> old;
+            for (const string& name: names) old.emplace (name, node);
+         }) / entries);
+      map<string,inode_ptr> old;
+      for (const string& name: names) old.emplace (name, node);
+      report ("table", "map lookup " + size, time_per_op (entries * 10,
+         [&] (size_t i) { sum += old.count (names[i % entries]); }));
+      report ("table", "map iterate " + size, time_per_op (reps,
+         [&] (size_t) {
+            for (const auto& entry: old) sum += entry.first.size();
+         }) / entries);
+      if (sum == 0) cout << "table     (unexpected empty sum)" << endl;
+      for (name_ref ref: refs) name_table::release (ref);
+   }
+}
+
+// Runs a command that must be refused with a command_error, as an
+// option out of range is, and complains if it is not.
+static void check_refused (const string& section, command_fn fn,
+                           const args& words) {
+   inode_state state;
+   try {
+      fn (state, words);
+   }catch (command_error&) {
+      return;
+   }
+   complain() << section << ": " << words << ": not refused" << endl;
+}
+
+// bench_export -
+//    Exports a tree of 100 directories of 1000 small files each to
+//    /tmp at 1, 2 and 4 threads.  export prints its own rates.  A -j
+//    too large to parse, or above the pool's limit, is refused.
+
+static void bench_export() {
+   constexpr size_t dirs = 100;
+   constexpr size_t files = 1000;
+   string top = "/tmp/benchmark." + to_string (getpid());
+   inode_state state;
+   for (size_t dir = 0; dir < dirs; ++dir) {
+      string path = "d" + to_string (dir);
+      fn_mkdir (state, args {"mkdir", path});
+      for (size_t file = 0; file < files; ++file) {
+         fn_make (state, args {"make", path + "/f" + to_string (file),
+                          "line", "one", "of", "file", "line", "two"});
+      }
+   }
+   for (const char* threads: {"1", "2", "4"}) {
+      cout << "export    -j " << threads << ": ";
+      fn_export (state, args {"export", "-j", threads, top});
+   }
+   for (const char* threads: {"99999999999999999999999", "100000"}) {
+      check_refused ("export", fn_export,
+                     args {"export", "-j", threads, top});
+   }
+   for (size_t dir = 0; dir < dirs; ++dir) {
+      string path = top + "/d" + to_string (dir);
+      for (size_t file = 0; file < files; ++file) {
+         unlink ((path + "/f" + to_string (file)).c_str());
+      }
+      rmdir (path.c_str());
+   }
+   rmdir (top.c_str());
+}
+
+// bench_import -
+//    Imports a host tree of 100 directories of 1000 small files each
+//    from /tmp at 1, 2 and 4 threads.  import prints its own rates.
+//    A -j too large to parse, or above the pool's limit, is refused.
+
+static void bench_import() {
+   constexpr size_t dirs = 100;
+   constexpr size_t files = 1000;
+   string top = "/tmp/benchmark." + to_string (getpid());
+   auto file_name = [&] (size_t dir, size_t file) {
+      return top + "/d" + to_string (dir) + "/f" + to_string (file);
+   };
+   mkdir (top.c_str(), 0777);
+   for (size_t dir = 0; dir < dirs; ++dir) {
+      mkdir ((top + "/d" + to_string (dir)).c_str(), 0777);
+      for (size_t file = 0; file < files; ++file) {
+         ofstream (file_name (dir, file))
+               << "line one of file " << file << "\nline two\n";
+      }
+   }
+   for (const char* threads: {"1", "2", "4"}) {
+      inode_state state;
+      cout << "import    -j " << threads << ": ";
+      fn_import (state, args {"import", "-j", threads, top});
+   }
+   for (const char* threads: {"99999999999999999999999", "100000"}) {
+      check_refused ("import", fn_import,
+                     args {"import", "-j", threads, top});
+   }
+   for (size_t dir = 0; dir < dirs; ++dir) {
+      for (size_t file = 0; file < files; ++file) {
+         unlink (file_name (dir, file).c_str());
+      }
+      rmdir ((top + "/d" + to_string (dir)).c_str());
+   }
+   rmdir (top.c_str());
+}
+
+// bench_journal -
+//    Throughput of mutating commands with the journal off, with
+//    group commit as in batch mode, and with a sync per command as
+//    in interactive mode.  The journal goes in /tmp.
+
+static void bench_journal() {
+   string filename = "/tmp/benchmark." + to_string (getpid()) + ".log";
+   auto run = [&] (const string& label, size_t commands,
+                   journal* log) {
+      inode_state state;
+      state.set_journal (log);
+      vector<string_view> words {"make", "", "some", "words"};
+      string name;
+      string line;
+      report ("journal", label, time_per_op (commands, [&] (size_t i) {
+         name = "f" + to_string (i);
+         words[1] = name;
+         if (log != nullptr) {
+            line = "make " + name + " some words";
+            log->record (line);
+         }
+         fn_make (state, words);
+      }));
+      if (log != nullptr) log->commit();
+   };
+   run ("make, no journal", 100000, nullptr);
+   {
+      journal grouped (filename, true);
+      run ("make, group commit", 100000, &grouped);
+      grouped.report (cout);
+   }
+   unlink (filename.c_str());
+   {
+      journal synced (filename, false);
+      run ("make, sync per command", 2000, &synced);
+      synced.report (cout);
+   }
+   unlink (filename.c_str());
+}
+
+// bench_lsr -
+//    Parallel lsr on a synthetic wide tree of 500 directories of 400
+//    files each, at 1, 2, 4 and 8 threads.
+
+static void bench_lsr() {
+   inode_state state;
+   for (size_t dir = 0; dir < 500; ++dir) {
+      string path = "d" + to_string (dir);
+      fn_mkdir (state, args {"mkdir", path});
+      for (size_t file = 0; file < 400; ++file) {
+         fn_make (state, args {"make", path + "/f" + to_string (file),
+                          "some", "words"});
+      }
+   }
+   for (const char* threads: {"1", "2", "4", "8"}) {
+      report ("lsr", string ("-j ") + threads, time_per_op (3,
+         [&] (size_t) { fn_lsr (state, args {"lsr", "-j", threads}); }));
+   }
+}
+
+//        *********************************************
+//        ************* Generated Workloads ***********
+//        *********************************************
+
+// Settings from the command line for the generated workloads.
+static size_t workload_scale = 1;
+static unsigned workload_seed = 1;
+static string yshell_path = "";
+
+using script = vector<string>;
+
+// A chain of depth nested directories, then repeated commands on the
+// full path to the bottom from the root.
+static script deep_workload() {
+   size_t depth = 500 * workload_scale;
+   script lines;
+   string path = "";
+   for (size_t level = 0; level < depth; ++level) {
+      lines.push_back ("mkdir d");
+      lines.push_back ("cd d");
+      path += "/d";
+   }
+   lines.push_back ("pwd");
+   for (size_t rep = 0; rep < 200; ++rep) {
+      lines.push_back ("cd /");
+      lines.push_back ("cd " + path);
+      lines.push_back ("pwd");
+      lines.push_back ("make " + path + "/f" + to_string (rep) + " x y");
+      lines.push_back ("cat " + path + "/f" + to_string (rep));
+      lines.push_back ("ls " + path);
+   }
+   return lines;
+}
+
+// One directory with many files:  made, read at random, listed, and
+// removed.
+static script wide_workload() {
+   size_t width = 20000 * workload_scale;
+   mt19937 random (workload_seed);
+   script lines;
+   for (size_t file = 0; file < width; ++file) {
+      lines.push_back ("make f" + to_string (file) + " some words");
+   }
+   for (size_t rep = 0; rep < width / 4; ++rep) {
+      lines.push_back ("cat f" + to_string (random() % width));
+   }
+   for (size_t rep = 0; rep < 5; ++rep) lines.push_back ("ls");
+   for (size_t file = 0; file < width; ++file) {
+      lines.push_back ("rm f" + to_string (file));
+   }
+   return lines;
+}
+
+// One file grown a line of 100 words at a time, then read whole.
+static script large_workload() {
+   size_t appends = 2000 * workload_scale;
+   string line = "append big";
+   for (size_t word = 0; word < 100; ++word) {
+      line += " word" + to_string (word);
+   }
+   script lines (appends, line);
+   for (size_t rep = 0; rep < 20; ++rep) lines.push_back ("cat big");
+   return lines;
+}
+
+// A random mix of make, ls, cd, cat, rm, mkdir and pwd over a small
+// two level tree, with absolute paths so every command can succeed.
+static script mixed_workload() {
+   size_t commands = 50000 * workload_scale;
+   mt19937 random (workload_seed);
+   script lines;
+   vector<string> dirs {"/"};
+   for (char top = 'a'; top <= 'h'; ++top) {
+      string dir = string ("/") + top;
+      lines.push_back ("mkdir " + dir);
+      dirs.push_back (dir + "/");
+      for (char sub = 'a'; sub <= 'h'; ++sub) {
+         lines.push_back ("mkdir " + dir + "/" + sub);
+         dirs.push_back (dir + "/" + sub + "/");
+      }
+   }
+   auto pick_dir = [&]() { return dirs[random() % dirs.size()]; };
+   auto pick_file = [&]() {
+      return pick_dir() + "f" + to_string (random() % 50);
+   };
+   for (size_t command = 0; command < commands; ++command) {
+      switch (random() % 10) {
+         case 0: case 1: case 2:
+            lines.push_back ("make " + pick_file() + " a b c d");
+            break;
+         case 3: lines.push_back ("ls " + pick_dir()); break;
+         case 4: lines.push_back ("cd " + pick_dir()); break;
+         case 5: case 6: lines.push_back ("cat " + pick_file()); break;
+         case 7: lines.push_back ("rm " + pick_file()); break;
+         case 8: lines.push_back ("mkdir " + pick_file() + "d"); break;
+         case 9: lines.push_back ("pwd"); break;
+      }
+   }
+   return lines;
+}
+
+// Runs a script through the command functions, timing each command
+// by itself, and prints the throughput and the 50th and 99th
+// percentile latency of each kind of command.  Failing commands are
+// timed too, since a script may well contain some.
+static void run_direct (const string& name, const script& lines) {
+   map<string,vector<double>> times;
+   inode_state state;
+   streambuf* saved = cout.rdbuf (null_out.rdbuf());
+   vector<string_view> words;
+   for (const string& line: lines) {
+      split_words (line, words);
+      command_fn fn = find_command_fn (words.at(0));
+      auto start = bench_clock::now();
+      try {
+         fn (state, words);
+      }catch (command_error&) {
+      }catch (file_error&) {
+      }
+      chrono::duration<double,nano> elapsed = bench_clock::now() - start;
+      times[string (words[0])].push_back (elapsed.count());
+   }
+   cout.rdbuf (saved);
+   for (auto& command: times) {
+      vector<double>& ns = command.second;
+      double total = 0;
+      for (double each: ns) total += each;
+      sort (ns.begin(), ns.end());
+      double p50 = ns[ns.size() / 2];
+      double p99 = ns[min (ns.size() - 1, ns.size() * 99 / 100)];
+      double per_sec = ns.size() / (total / 1e9);
+      cout << left << setw (10) << name << setw (8) << command.first
+           << right << setw (9) << ns.size() << setw (14) << fixed
+           << setprecision (0) << per_sec << " ops/sec  p50"
+           << setw (10) << setprecision (1) << p50 << " ns  p99"
+           << setw (10) << p99 << " ns" << endl;
+      record (name, command.first + " ops/sec", per_sec, "ops/sec");
+      record (name, command.first + " p50", p50, "ns");
+      record (name, command.first + " p99", p99, "ns");
+   }
+}
+
+static string write_script (const script& lines, const string& tag) {
+   string filename = "/tmp/benchmark." + to_string (getpid()) + tag
+                   + ".ysh";
+   ofstream out (filename);
+   for (const string& line: lines) out << line << '\n';
+   return filename;
+}
+
+// Starts the yshell binary with the given options and a file as its
+// stdin, and its output discarded.
+static pid_t spawn_yshell (const vector<string>& options,
+                           const string& input_name) {
+   pid_t child = fork();
+   if (child == 0) {
+      int input = open (input_name.c_str(), O_RDONLY);
+      int output = open ("/dev/null", O_WRONLY);
+      dup2 (input, STDIN_FILENO);
+      dup2 (output, STDOUT_FILENO);
+      dup2 (output, STDERR_FILENO);
+      vector<char*> argv {const_cast<char*> ("yshell")};
+      for (const string& option: options) {
+         argv.push_back (const_cast<char*> (option.c_str()));
+      }
+      argv.push_back (nullptr);
+      execv (yshell_path.c_str(), argv.data());
+      _exit (127);
+   }
+   return child;
+}
+
+// Waits for a child started by spawn_yshell, returning false if it
+// could not be run.
+static bool reap_yshell (pid_t child) {
+   int status = 0;
+   if (child <= 0 or waitpid (child, &status, 0) != child) return false;
+   return WIFEXITED (status) and WEXITSTATUS (status) != 127;
+}
+
+// Runs a script through the yshell binary, in batch mode or as
+// interactive input, and returns lines per second, or zero if the
+// binary could not be run.
+static double run_repl (const script& lines, bool batch) {
+   string filename = write_script (lines, "");
+   auto start = bench_clock::now();
+   pid_t child = spawn_yshell (batch ? vector<string> {"-b"}
+                                     : vector<string> {}, filename);
+   bool ran = reap_yshell (child);
+   chrono::duration<double> elapsed = bench_clock::now() - start;
+   unlink (filename.c_str());
+   if (not ran) return 0;
+   return lines.size() / elapsed.count();
+}
+
+static void run_workload (const string& name, const script& lines) {
+   run_direct (name, lines);
+   for (bool batch: {true, false}) {
+      string mode = batch ? "repl -b" : "repl";
+      double per_sec = run_repl (lines, batch);
+      if (per_sec == 0) {
+         cout << left << setw (10) << name << setw (8) << mode
+              << " cannot run " << yshell_path << endl;
+         continue;
+      }
+      cout << left << setw (10) << name << setw (8) << mode << right
+           << setw (9) << lines.size() << setw (14) << fixed
+           << setprecision (0) << per_sec << " lines/sec" << endl;
+      record (name, mode + " lines/sec", per_sec, "lines/sec");
+   }
+}
+
+static void bench_deep()  { run_workload ("deep" , deep_workload());  }
+static void bench_wide()  { run_workload ("wide" , wide_workload());  }
+static void bench_large() { run_workload ("large", large_workload()); }
+static void bench_mixed() { run_workload ("mixed", mixed_workload()); }
+
+// One user's commands, all relative to a directory of their own, so
+// that sessions sharing a tree do not touch each other's files.
+static script session_workload (const string& home) {
+   size_t commands = 5000 * workload_scale;
+   mt19937 random (workload_seed);
+   script lines {"mkdir " + home, "cd " + home};
+   auto pick_file = [&]() { return "f" + to_string (random() % 200); };
+   for (size_t command = 0; command < commands; ++command) {
+      switch (random() % 10) {
+         case 0: case 1:
+            lines.push_back ("make " + pick_file() + " a b c d");
+            break;
+         case 2: case 3: lines.push_back ("ls"); break;
+         case 4: case 5: case 6:
+            lines.push_back ("cat " + pick_file());
+            break;
+         case 7: lines.push_back ("rm " + pick_file()); break;
+         case 8: lines.push_back ("mkdir " + pick_file() + "d"); break;
+         case 9: lines.push_back ("pwd"); break;
+      }
+   }
+   return lines;
+}
+
+// bench_server -
+//    Many users at once, each running a script of their own:  as one
+//    yshell process per user, each with a tree of its own, and as
+//    clients of one server, all on its tree.  Reports the lines per
+//    second over all of them.
+
+static void bench_server() {
+   string socket_path = "/tmp/benchmark." + to_string (getpid())
+                      + ".sock";
+   pid_t server = spawn_yshell ({"-S", socket_path}, "/dev/null");
+   struct stat status;
+   for (size_t tries = 0; tries < 200
+        and stat (socket_path.c_str(), &status) != 0; ++tries) {
+      usleep (10000);
+   }
+   size_t round = 0;
+   for (size_t users: {1, 2, 4, 8}) {
+      for (bool served: {false, true}) {
+         vector<string> filenames;
+         size_t lines = 0;
+         for (size_t user = 0; user < users; ++user) {
+            script commands = session_workload ("r" + to_string (round)
+                                                + "u" + to_string (user));
+            lines += commands.size();
+            filenames.push_back (write_script (commands,
+                                               "." + to_string (user)));
+         }
+         ++round;
+         auto start = bench_clock::now();
+         vector<pid_t> children;
+         for (const string& filename: filenames) {
+            children.push_back (served
+                  ? spawn_yshell ({"-c", socket_path}, filename)
+                  : spawn_yshell ({"-b"}, filename));
+         }
+         bool ran = true;
+         for (pid_t child: children) ran = reap_yshell (child) and ran;
+         chrono::duration<double> elapsed = bench_clock::now() - start;
+         for (const string& filename: filenames) unlink (filename.c_str());
+         string mode = (served ? "server " : "procs ") + to_string (users);
+         if (not ran) {
+            cout << left << setw (10) << "server" << setw (10) << mode
+                 << " cannot run " << yshell_path << endl;
+            continue;
+         }
+         double per_sec = lines / elapsed.count();
+         cout << left << setw (10) << "server" << setw (10) << mode
+              << right << setw (9) << lines << setw (14) << fixed
+              << setprecision (0) << per_sec << " lines/sec" << endl;
+         record ("server", mode + " lines/sec", per_sec, "lines/sec");
+      }
+   }
+   if (server > 0) kill (server, SIGTERM);
+   reap_yshell (server);
+}
+
+//        *********************************************
+//        ************* Concurrent Sessions ***********
+//        *********************************************
+
+// Runs a line for a session on a shared tree, as the server does, or
+// with the whole tree locked for every command, as it did before
+// directories and files had locks of their own.  Returns false if the
+// command failed.
+static bool run_session_line (inode_state& state, const string& line,
+                              bool coarse) {
+   static thread_local vector<string_view> words;
+   split_words (line, words);
+   try {
+      const command_info& command = find_command (words.at(0));
+      if (coarse) {
+         unique_lock<shared_mutex> guard (state.get_tree()->lock);
+         run_command (state, command, words);
+      }else {
+         run_locked (state, command, words);
+      }
+      return true;
+   }catch (command_error&) {
+   }catch (file_error&) {
+   }
+   return false;
+}
+
+// Runs a script per thread, each as a session of its own on the tree
+// of state, all at once.  Returns the lines run per second over all of
+// them, and adds the number that failed to failed.
+static double run_sessions (inode_state& state,
+                            const vector<script>& scripts, bool coarse,
+                            size_t& failed) {
+   atomic<size_t> failures {0};
+   size_t lines = 0;
+   for (const script& each: scripts) lines += each.size();
+   auto start = bench_clock::now();
+   vector<thread> workers;
+   for (const script& each: scripts) {
+      workers.emplace_back ([&state, &each, &failures, coarse]() {
+         ofstream discard ("/dev/null");
+         inode_state session (state.get_tree());
+         session.set_output (discard);
+         size_t session_failures = 0;
+         for (const string& line: each) {
+            if (not run_session_line (session, line, coarse)) {
+               ++session_failures;
+            }
+         }
+         failures += session_failures;
+      });
+   }
+   for (thread& worker: workers) worker.join();
+   chrono::duration<double> elapsed = bench_clock::now() - start;
+   failed += failures;
+   return lines / elapsed.count();
+}
+
+// A random mix of cat, ls, cd and pwd over /d0 to /d15, which each
+// hold 1000 files and 10 small directories, with writes making up the
+// given percentage:  make over existing files, mkdir of new names in a
+// directory of the thread's own, and the odd rm of one of those.
+static script concurrent_workload (size_t thread_nr, size_t write_percent) {
+   size_t commands = 20000 * workload_scale;
+   mt19937 random (workload_seed + thread_nr);
+   script lines;
+   string own = "/d" + to_string (thread_nr % 16) + "/t"
+              + to_string (thread_nr);
+   lines.push_back ("mkdir " + own);
+   size_t made = 0;
+   auto pick_dir = [&]() { return "/d" + to_string (random() % 16); };
+   for (size_t command = 1; command < commands; ++command) {
+      if (random() % 100 < write_percent) {
+         size_t choice = random() % 10;
+         if (choice < 6) {
+            lines.push_back ("make " + pick_dir() + "/f"
+                             + to_string (random() % 1000) + " new words");
+         }else if (choice < 9 or made == 0) {
+            lines.push_back ("mkdir " + own + "/n" + to_string (made++));
+         }else {
+            lines.push_back ("rm " + own + "/n" + to_string (--made));
+         }
+         continue;
+      }
+      switch (random() % 4) {
+         case 0:
+            lines.push_back ("cat " + pick_dir() + "/f"
+                             + to_string (random() % 1000));
+            break;
+         case 1:
+            lines.push_back ("ls " + pick_dir() + "/s"
+                             + to_string (random() % 10));
+            break;
+         case 2:
+            lines.push_back ("cd " + pick_dir() + "/s"
+                             + to_string (random() % 10));
+            break;
+         case 3: lines.push_back ("pwd"); break;
+      }
+   }
+   return lines;
+}
+
+// bench_sessions -
+//    Sessions on one tree, 1 to 16 of them on as many threads, running
+//    only reads and then a mix with 20% writes.  The mix is run again
+//    with every command holding the whole tree, to show what the
+//    per-directory locks gain.  Lines per second are over all threads.
+
+static void bench_sessions() {
+   inode_state state;
+   for (size_t dir = 0; dir < 16; ++dir) {
+      string path = "/d" + to_string (dir);
+      fn_mkdir (state, args {"mkdir", path});
+      for (size_t file = 0; file < 1000; ++file) {
+         fn_make (state, args {"make", path + "/f" + to_string (file),
+                               "some", "words"});
+      }
+      for (size_t sub = 0; sub < 10; ++sub) {
+         fn_mkdir (state, args {"mkdir", path + "/s" + to_string (sub)});
+      }
+   }
+   struct mode {
+      string name;
+      size_t write_percent;
+      bool coarse;
+   };
+   for (const mode& each: {mode {"read", 0, false},
+                           mode {"mixed", 20, false},
+                           mode {"mixed coarse", 20, true}}) {
+      for (size_t threads: {1, 2, 4, 8, 16}) {
+         vector<script> scripts;
+         for (size_t thread_nr = 0; thread_nr < threads; ++thread_nr) {
+            scripts.push_back (concurrent_workload (thread_nr,
+                                                    each.write_percent));
+         }
+         size_t failed = 0;
+         double per_sec = run_sessions (state, scripts, each.coarse, failed);
+         fn_rmr (state, args {"rmr", "/d0/t0"});
+         for (size_t thread_nr = 1; thread_nr < threads; ++thread_nr) {
+            fn_rmr (state, args {"rmr", "/d" + to_string (thread_nr % 16)
+                                 + "/t" + to_string (thread_nr)});
+         }
+         string what = each.name + " " + to_string (threads);
+         cout << left << setw (10) << "sessions" << setw (16) << what
+              << right << setw (14) << fixed << setprecision (0)
+              << per_sec << " lines/sec" << endl;
+         record ("sessions", what + " lines/sec", per_sec, "lines/sec");
+      }
+   }
+}
+
+// Checks every directory below the root:  its dot and dotdot, that
+// its entries are in order and carry the names they are filed under,
+// and that no inode number is used twice.  Returns the number of
+// inodes in the tree, or zero after complaining about the first
+// problem found.
+static size_t check_tree (const inode_ptr& root) {
+   unordered_set<int> numbers {root->get_inode_nr()};
+   vector<pair<inode_ptr,inode_ptr>> stack {{root, root}};
+   size_t inodes = 1;
+   while (not stack.empty()) {
+      auto [dir, parent] = stack.back();
+      stack.pop_back();
+      const base_file_ptr& contents = dir->get_contents();
+      if (contents->lookup (".", false) != dir
+          or contents->lookup ("..", false) != parent) {
+         complain() << "stress: " << dir->get_name()
+                    << ": bad dot or dotdot" << endl;
+         return 0;
+      }
+      auto guard = contents->read_lock();
+      const dirent* last = nullptr;
+      for (const dirent& entry: contents->get_dirents()) {
+         if ((last != nullptr and compare_names (*last->name, last->is_dir,
+                                  *entry.name, entry.is_dir) >= 0)
+             or entry.node->get_name_ref() != entry.name
+             or entry.node->get_contents()->is_dir() != entry.is_dir) {
+            complain() << "stress: " << dir->get_name() << *entry.name
+                       << ": bad dirent" << endl;
+            return 0;
+         }
+         if (not numbers.insert (entry.node->get_inode_nr()).second) {
+            complain() << "stress: inode " << entry.node->get_inode_nr()
+                       << " used twice" << endl;
+            return 0;
+         }
+         ++inodes;
+         if (entry.is_dir) stack.push_back ({entry.node, dir});
+         last = &entry;
+      }
+   }
+   return inodes;
+}
+
+// Has 16 sessions at once make and append the same new names in one
+// directory, which must never fail however their lookups and creates
+// interleave, and then checks that every append reached the one file
+// all of them share.  Complains and returns false if not.
+static bool check_creates() {
+   const size_t sessions = 16;
+   const size_t names = 200 * workload_scale;
+   inode_state state;
+   fn_mkdir (state, args {"mkdir", "/s"});
+   vector<script> scripts;
+   for (size_t thread_nr = 0; thread_nr < sessions; ++thread_nr) {
+      script lines;
+      for (size_t name = 0; name < names; ++name) {
+         lines.push_back ("make /s/m" + to_string (name) + " a b");
+         lines.push_back ("append /s/a" + to_string (name) + " c");
+      }
+      scripts.push_back (move (lines));
+   }
+   size_t failed = 0;
+   run_sessions (state, scripts, false, failed);
+   if (failed > 0) {
+      complain() << "stress: " << failed << " of " << sessions * names * 2
+                 << " make and append lines failed" << endl;
+      return false;
+   }
+   inode_ptr dir = state.get_root()->get_contents()->lookup ("s", true);
+   for (size_t name = 0; name < names; ++name) {
+      inode_ptr file = dir->get_contents()->lookup (
+                       "a" + to_string (name), false);
+      if (file == nullptr
+          or file->get_contents()->readfile().size() != sessions) {
+         complain() << "stress: /s/a" << name << ": appends lost"
+                    << endl;
+         return false;
+      }
+   }
+   return true;
+}
+
+// bench_stress -
+//    16 sessions at once making, writing, reading, listing, entering
+//    and removing the same few names in the same few directories, so
+//    that they collide as often as they can.  Then the tree is checked,
+//    and every inode still allocated must be in it.  Then 16 sessions
+//    make and append the same new names, none of which may fail.  Sets
+//    the exit status if anything is wrong.
+
+static void bench_stress() {
+   size_t live_before = inode::live_count();
+   size_t inodes = 0;
+   size_t failed = 0;
+   size_t lines = 0;
+   {
+      inode_state state;
+      for (const char* dir: {"/a", "/b", "/c"}) {
+         fn_mkdir (state, args {"mkdir", dir});
+      }
+      vector<script> scripts;
+      for (size_t thread_nr = 0; thread_nr < 16; ++thread_nr) {
+         mt19937 random (workload_seed + thread_nr);
+         script lines;
+         for (size_t command = 0; command < 5000 * workload_scale;
+              ++command) {
+            string dir = string ("/") + "abc"[random() % 3];
+            string name = dir + "/x" + to_string (random() % 8);
+            switch (random() % 12) {
+               case 0: lines.push_back ("make " + name + " a b"); break;
+               case 1: lines.push_back ("append " + name + " c"); break;
+               case 2: lines.push_back ("mkdir " + name); break;
+               case 3: lines.push_back ("mkdir " + name + "/y"); break;
+               case 4: lines.push_back ("rm " + name); break;
+               case 5: lines.push_back ("rmr " + name); break;
+               case 6: lines.push_back ("cat " + name); break;
+               case 7: lines.push_back ("ls " + dir); break;
+               case 8: lines.push_back ("lsr " + dir); break;
+               case 9: lines.push_back ("cd " + name); break;
+               case 10: lines.push_back ("cd /"); break;
+               case 11: lines.push_back ("pwd"); break;
+            }
+         }
+         scripts.push_back (move (lines));
+      }
+      for (const script& each: scripts) lines += each.size();
+      double per_sec = run_sessions (state, scripts, false, failed);
+      inodes = check_tree (state.get_root());
+      if (inodes > 0 and inode::live_count() - live_before != inodes) {
+         complain() << "stress: " << inodes << " inodes in the tree but "
+                    << inode::live_count() - live_before << " live"
+                    << endl;
+         inodes = 0;
+      }
+      cout << left << setw (10) << "stress" << setw (16) << "16 sessions"
+           << right << setw (14) << fixed << setprecision (0) << per_sec
+           << " lines/sec" << endl;
+      record ("stress", "16 sessions lines/sec", per_sec, "lines/sec");
+   }
+   if (inodes > 0) {
+      cout << left << setw (10) << "stress" << lines << " lines, "
+           << failed << " failed, " << inodes
+           << " inodes in a consistent tree" << endl;
+   }
+   if (inode::live_count() != live_before) {
+      complain() << "stress: " << inode::live_count() - live_before
+                 << " inodes leaked" << endl;
+   }
+   if (check_creates()) {
+      cout << left << setw (10) << "stress"
+           << "16 sessions made and appended the same names" << endl;
+   }
+}
+
+int main (int argc, char** argv) {
+   execname (argv[0]);
+   string results_file = "";
+   string self = argv[0];
+   size_t slash = self.find_last_of ('/');
+   yshell_path = slash == string::npos ? "./yshell"
+               : self.substr (0, slash + 1) + "yshell";
+   for (;;) {
+      int option = getopt (argc, argv, "o:n:s:y:");
+      if (option == EOF) break;
+      switch (option) {
+         case 'o': results_file = optarg; break;
+         case 'n': workload_scale = max (1, atoi (optarg)); break;
+         case 's': workload_seed = atoi (optarg); break;
+         case 'y': yshell_path = optarg; break;
+         default:
+            complain() << "-" << static_cast<char> (optopt)
+                       << ": invalid option" << endl;
+            break;
+      }
+   }
+   map<string,function<void()>> sections {
+      {"append" , bench_append },
+      {"build"  , bench_build  },
+      {"cat"    , bench_cat    },
+      {"deep"   , bench_deep   },
+      {"dentry" , bench_dentry },
+      {"dirents", bench_dirents},
+      {"dispatch", bench_dispatch},
+      {"export" , bench_export },
+      {"import" , bench_import },
+      {"journal", bench_journal},
+      {"large"  , bench_large  },
+      {"lsr"    , bench_lsr    },
+      {"mixed"  , bench_mixed  },
+      {"pwd"    , bench_pwd    },
+      {"reclaim", bench_reclaim},
+      {"server" , bench_server },
+      {"sessions", bench_sessions},
+      {"snapshot", bench_snapshot},
+      {"split"  , bench_split  },
+      {"stress" , bench_stress },
+      {"table"  , bench_table  },
+      {"trace"  , bench_trace  },
+      {"wide"   , bench_wide   },
+   };
+   if (optind == argc) {
+      for (const auto& section: sections) section.second();
+   }
+   for (int argi = optind; argi < argc; ++argi) {
+      auto section = sections.find (argv[argi]);
+      if (section == sections.end()) {
+         complain() << argv[argi] << ": no such section" << endl;
+         continue;
+      }
+      section->second();
+   }
+   if (not results_file.empty()) write_results (results_file);
+   return exit_status::get();
+}
@@ -2,33 +2,148 @@
 // Partner: Darius Sakhapour(dsakhapo@ucsc.edu)
 // Partner: Ryan Wong (rystwong@ucsc.edu)
 
+#include <charconv>
+#include <chrono>
+#include <mutex>
+#include <shared_mutex>
+
+using namespace std;
+
 #include "commands.h"
 #include "debug.h"
+#include "journal.h"
+#include "thread_pool.h"
 
-command_hash cmd_hash {
-   {"#"     , fn_comm  },
-   {"cat"   , fn_cat   },
-   {"cd"    , fn_cd    },
-   {"echo"  , fn_echo  },
-   {"exit"  , fn_exit  },
-   {"ls"    , fn_ls    },
-   {"lsr"   , fn_lsr   },
-   {"make"  , fn_make  },
-   {"mkdir" , fn_mkdir },
-   {"prompt", fn_prompt},
-   {"pwd"   , fn_pwd   },
-   {"rm"    , fn_rm    },
+constexpr command_entry commands[] {
+   {"#"      , {fn_comm   , false, false, false}},
+   {"append" , {fn_append , true , false, false}},
+   {"cat"    , {fn_cat    , false, false, false}},
+   {"cd"     , {fn_cd     , true , false, false}},
+   {"compact", {fn_compact, false, true , false}},
+   {"echo"   , {fn_echo   , false, false, false}},
+   {"exit"   , {fn_exit   , false, false, false}},
+   {"export" , {fn_export , false, false, false}},
+   {"import" , {fn_import , true , false, true }},
+   {"load"   , {fn_load   , true , true , true }},
+   {"ls"     , {fn_ls     , false, false, false}},
+   {"lsr"    , {fn_lsr    , false, false, false}},
+   {"make"   , {fn_make   , true , false, false}},
+   {"mkdir"  , {fn_mkdir  , true , false, false}},
+   {"prompt" , {fn_prompt , true , false, false}},
+   {"pwd"    , {fn_pwd    , false, false, false}},
+   {"rm"     , {fn_rm     , true , true , false}},
+   {"rmr"    , {fn_rmr    , true , true , false}},
+   {"save"   , {fn_save   , false, true , false}},
+   {"stats"  , {fn_stats  , false, false, false}},
 };
+constexpr size_t command_count = sizeof commands / sizeof commands[0];
+
+// The perfect hash.  A name's length and its first, second and last
+// bytes are packed into one word, which is multiplied by a seed and
+// the top bits taken as the slot.  The seed is the first one, found
+// by the compiler, for which no two commands share a slot.
+constexpr size_t slot_bits = 6;
+constexpr size_t slot_count = size_t (1) << slot_bits;
+static_assert (command_count < slot_count, "too many commands");
+
+constexpr uint32_t command_key (string_view name) {
+   uint32_t second = name.size() > 1
+                   ? static_cast<unsigned char> (name[1]) : 0;
+   return static_cast<uint32_t> (name.size())
+        | static_cast<uint32_t> (static_cast<unsigned char> (name[0])) << 8
+        | second << 16
+        | static_cast<uint32_t> (static_cast<unsigned char> (name.back()))
+          << 24;
+}
+
+constexpr size_t command_slot (uint32_t key, uint32_t seed) {
+   return static_cast<uint32_t> (key * seed) >> (32 - slot_bits);
+}
+
+constexpr bool seed_is_perfect (uint32_t seed) {
+   bool taken[slot_count] {};
+   for (const command_entry& entry: commands) {
+      size_t slot = command_slot (command_key (entry.name), seed);
+      if (taken[slot]) return false;
+      taken[slot] = true;
+   }
+   return true;
+}
+
+constexpr uint32_t find_seed() {
+   uint32_t seed = 0x9E3779B1;
+   while (not seed_is_perfect (seed)) seed += 2;
+   return seed;
+}
+
+constexpr uint32_t command_seed = find_seed();
+
+// For each slot, the index of its command plus one, or zero if the
+// slot is empty.
+struct slot_table {
+   uint8_t command[slot_count] {};
+};
+
+constexpr slot_table make_slot_table() {
+   slot_table table {};
+   for (size_t index = 0; index < command_count; ++index) {
+      size_t slot = command_slot (command_key (commands[index].name),
+                                  command_seed);
+      table.command[slot] = index + 1;
+   }
+   return table;
+}
+
+constexpr slot_table command_slots = make_slot_table();
 
-command_fn find_command_fn (const string& cmd) {
-   // Note: value_type is pair<const key_type, mapped_type>
-   // So: iterator->first is key_type (string)
-   // So: iterator->second is mapped_type (command_fn)
-   const auto result = cmd_hash.find (cmd);
-   if (result == cmd_hash.end()) {
-      throw command_error (cmd + ": no such function");
+command_list command_names() {
+   return {commands, command_count};
+}
+
+const command_info& find_command (string_view cmd) {
+   if (not cmd.empty()) {
+      size_t slot = command_slot (command_key (cmd), command_seed);
+      size_t index = command_slots.command[slot];
+      if (index > 0 and commands[index - 1].name == cmd) {
+         return commands[index - 1].info;
+      }
+   }
+   throw command_error (string (cmd) + ": no such function");
+}
+
+command_fn find_command_fn (string_view cmd) {
+   return find_command (cmd).fn;
+}
+
+void run_command (inode_state& state, const command_info& command,
+                  word_span words) {
+   auto start = chrono::steady_clock::now();
+   auto finish = [&] (bool failed) {
+      state.get_stats().record_command (words[0],
+            chrono::steady_clock::now() - start, failed);
+   };
+   try {
+      command.fn (state, words);
+   }catch (ysh_exit&) {
+      finish (false);
+      throw;
+   }catch (...) {
+      finish (true);
+      throw;
+   }
+   finish (false);
+}
+
+void run_locked (inode_state& state, const command_info& command,
+                 word_span words) {
+   shared_tree& tree = *state.get_tree();
+   if (command.exclusive) {
+      unique_lock<shared_mutex> guard (tree.lock);
+      run_command (state, command, words);
+   }else {
+      shared_lock<shared_mutex> guard (tree.lock);
+      run_command (state, command, words);
    }
-   return result->second;
 }
 
 command_error::command_error (const string& what):
@@ -42,13 +157,22 @@ int exit_status_message() {
 }
 
 // Comment function. Doesn't return or do anything.
-void fn_comm(inode_state& state, const wordvec& words) {
+void fn_comm(inode_state& state, word_span words) {
    // This has been intentionally left empty;
    DEBUGF('c', state);
    DEBUGF('c', words);
 }
 
-void fn_cat(inode_state& state, const wordvec& words) {
+// Adds words to the end of a file, creating the file if needed.
+void fn_append(inode_state& state, word_span words) {
+   if(words.size() == 1)
+      throw command_error("fn_append: no args specified");
+   state.append_file(state.get_cwd(), words);
+   DEBUGF('c', state);
+   DEBUGF('c', words);
+}
+
+void fn_cat(inode_state& state, word_span words) {
    if(words.size() == 1)
       throw command_error("fn_cat: no args specified");
    if (words.size() > 1) {
@@ -58,22 +182,33 @@ void fn_cat(inode_state& state, const wordvec& words) {
       DEBUGF('c', words);
 }
 
-void fn_cd (inode_state& state, const wordvec& words){
+void fn_cd (inode_state& state, word_span words){
    state.change_directory(state, words);
    DEBUGF ('c', state);
    DEBUGF ('c', words);
 }
 
-void fn_echo (inode_state& state, const wordvec& words){
+// Folds the journal into a snapshot.
+void fn_compact (inode_state& state, word_span words){
+   if(words.size() != 1) throw command_error("fn_compact: no args");
+   if(state.get_journal() == nullptr){
+      throw command_error("fn_compact: no journal");
+   }
+   state.get_journal()->compact(state);
    DEBUGF ('c', state);
    DEBUGF ('c', words);
-   cout << word_range (words.cbegin() + 1, words.cend()) << endl;
+}
+
+void fn_echo (inode_state& state, word_span words){
+   DEBUGF ('c', state);
+   DEBUGF ('c', words);
+   state.out() << words.subspan (1) << endl;
 }
 
 // Exit function. If exit is called with arguments, the arguments are
 // parsed as exit status. If the argument is an int, that int will be
 // returned. If it is not an int, the int 127 will be passed instead.
-void fn_exit (inode_state& state, const wordvec& words){
+void fn_exit (inode_state& state, word_span words){
    if (words.size() > 1) {
       exit_status e;
       string s = "";
@@ -97,9 +232,74 @@ void fn_exit (inode_state& state, const wordvec& words){
    throw ysh_exit();
 }
 
+// Parses the number that follows an option such as -d, at words[i],
+// stepping i past it.  Throws a command_error naming the command and
+// the option if it is missing, is not all digits, or is above limit.
+static size_t parse_number(const string& name, string_view flag,
+                           word_span words, size_t& i, size_t limit) {
+   if (++i == words.size() or words[i].empty()
+       or words[i].find_first_not_of("0123456789") != string::npos) {
+      throw command_error(name + ": " + string(flag)
+                          + " needs a number");
+   }
+   size_t number = 0;
+   auto [end, error] = from_chars(words[i].data(),
+                                  words[i].data() + words[i].size(),
+                                  number);
+   if (error != errc() or number > limit) {
+      throw command_error(name + ": " + string(flag)
+                          + ": number out of range");
+   }
+   return number;
+}
+
+// Parses the options shared by import and export:
+//    -j N   read or write host files on N threads.
+// followed by the host directory and an optional pathname.
+static host_options parse_host_options(const string& name,
+                                       word_span words) {
+   host_options options;
+   size_t operands = 0;
+   for (size_t i = 1; i < words.size(); ++i) {
+      if (words[i] == "-j") {
+         options.threads = parse_number(name, "-j", words, i,
+                                        thread_pool::max_threads);
+      }
+      else if (operands++ == 0) options.host_dir = words[i];
+      else if (operands == 2) options.pathname = words[i];
+      else throw command_error(name + ": invalid num of args");
+   }
+   if (operands == 0) throw command_error(name + ": no host directory");
+   return options;
+}
+
+// Copies a host directory tree into the simulated file system.
+void fn_import (inode_state& state, word_span words){
+   state.import_tree(state.get_cwd(),
+                     parse_host_options("fn_import", words));
+   DEBUGF ('c', state);
+   DEBUGF ('c', words);
+}
+
+// Mirrors a directory tree of the simulated file system on the host.
+void fn_export (inode_state& state, word_span words){
+   state.export_tree(state.get_cwd(),
+                     parse_host_options("fn_export", words));
+   DEBUGF ('c', state);
+   DEBUGF ('c', words);
+}
+
+// Replaces the whole tree with a snapshot read from a host file.
+void fn_load (inode_state& state, word_span words){
+   if(words.size() != 2) throw command_error("fn_load: needs a filename");
+   state.load_snapshot(string(words.at(1)));
+   DEBUGF ('c', state);
+   DEBUGF ('c', words);
+}
+
 // Displays the entities within a current directory, including files
 // and other directories.
-void fn_ls (inode_state& state, const wordvec& words){
+void fn_ls (inode_state& state, word_span words){
    if(words.size() <= 2){
       state.print_directory(state.get_cwd(), words);
    }
@@ -108,22 +308,37 @@ void fn_ls (inode_state& state, const wordvec& words){
    DEBUGF ('c', words);
 }
 
-void fn_lsr (inode_state& state, const wordvec& words){
-   if(words.size() <= 2){
-      state.list_recursively(state, words);
+// Lists a directory tree.  Options:
+//    -d N   descend at most N levels below the starting directory.
+//    -c     print only the number of entries in each directory.
+//    -j N   format the listing on N threads (same output).
+void fn_lsr (inode_state& state, word_span words){
+   lsr_options options;
+   for (size_t i = 1; i < words.size(); ++i) {
+      if (words[i] == "-c") options.counts_only = true;
+      else if (words[i] == "-d") {
+         options.max_depth = parse_number("fn_lsr", "-d", words, i,
+                                          SIZE_MAX);
+      }
+      else if (words[i] == "-j") {
+         options.threads = parse_number("fn_lsr", "-j", words, i,
+                                        thread_pool::max_threads);
+      }
+      else if (options.pathname.empty()) options.pathname = words[i];
+      else throw command_error("fn_lsr: invalid num of args");
    }
-   else throw command_error("fn_lsr: invalid num of args");
+   state.list_recursively(state.get_cwd(), options);
    DEBUGF ('c', state);
    DEBUGF ('c', words);
 }
 
-void fn_make (inode_state& state, const wordvec& words){
+void fn_make (inode_state& state, word_span words){
    state.create_file(state.get_cwd(), words);
    DEBUGF ('c', state);
    DEBUGF ('c', words);
 }
 
-void fn_mkdir (inode_state& state, const wordvec& words){
+void fn_mkdir (inode_state& state, word_span words){
    if(words.size() == 1) throw command_error("fn_mkdir: no arg");
    else if(words.size() == 2){
       state.make_directory(state.get_cwd(), words);
@@ -134,7 +349,7 @@ void fn_mkdir (inode_state& state, const wordvec& words){
 }
 
 // Changes the character to be used as the prompt character.
-void fn_prompt (inode_state& state, const wordvec& words){
+void fn_prompt (inode_state& state, word_span words){
    string new_prompt = "";
    for (size_t i = 1; i < words.size(); ++i) {
       new_prompt += words.at(i);
@@ -145,20 +360,43 @@ void fn_prompt (inode_state& state, const wordvec& words){
    DEBUGF ('c', words);
 }
 
-void fn_pwd (inode_state& state, const wordvec& words){
+void fn_pwd (inode_state& state, word_span words){
    if(words.size() == 1) state.print_path(state.get_cwd());
    else throw command_error("fn_pwd: invalid num of args");
    DEBUGF ('c', state);
    DEBUGF ('c', words);
 }
 
-void fn_rm (inode_state& state, const wordvec& words){
+void fn_rm (inode_state& state, word_span words){
    state.remove(state.get_cwd(), words);
    DEBUGF ('c', state);
    DEBUGF ('c', words);
 }
-//NEED TO DO
-void fn_rmr (inode_state& state, const wordvec& words){
+// Removes files and directories along with everything under them.
+void fn_rmr (inode_state& state, word_span words){
+   state.remove_recursively(state.get_cwd(), words);
+   DEBUGF ('c', state);
+   DEBUGF ('c', words);
+}
+
+// Writes the whole tree to a host file as a snapshot.
+void fn_save (inode_state& state, word_span words){
+   if(words.size() != 2) throw command_error("fn_save: needs a filename");
+   state.save_snapshot(string(words.at(1)));
+   DEBUGF ('c', state);
+   DEBUGF ('c', words);
+}
+
+// Prints the session's command latencies, inode and allocation
+// counts and lookup depths, as a table or, with -j, as JSON.
+void fn_stats (inode_state& state, word_span words){
+   if(words.size() == 1){
+      state.get_stats().report(state.out(), state.get_dentries());
+   }
+   else if(words.size() == 2 and words[1] == "-j"){
+      state.get_stats().write_json(state.out(), state.get_dentries());
+   }
+   else throw command_error("fn_stats: invalid arg");
    DEBUGF ('c', state);
    DEBUGF ('c', words);
 }
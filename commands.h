@@ -5,7 +5,8 @@
 #ifndef __COMMANDS_H__
 #define __COMMANDS_H__
 
-#include <unordered_map>
+#include <cstdint>
+#include <string_view>
 using namespace std;
 
 #include "file_sys.h"
@@ -13,8 +14,45 @@ using namespace std;
 
 // A couple of convenient usings to avoid verbosity.
 
-using command_fn = void (*)(inode_state& state, const wordvec& words);
-using command_hash = unordered_map<string,command_fn>;
+// command_info -
+//    The function that runs a command, which is handed the words of
+//    the command line as views into it, and whether the command
+//    changes the tree, the cwd or the prompt, which is what decides
+//    if it is written to the journal, and whether it needs the tree
+//    to itself when sessions share it:  rm and rmr free inodes and
+//    must see every session's cwd hold still, load replaces the
+//    tree, and save and compact write all of it at one instant.
+//    Last is whether it reads host files into the tree, as import
+//    and load do, which the journal cannot replay from its line.
+
+using command_fn = void (*)(inode_state& state, word_span words);
+struct command_info {
+   command_fn fn;
+   bool mutates;
+   bool exclusive;
+   bool reads_host;
+};
+
+// command_entry -
+//    One command in the table find_command searches:  its name and
+//    what runs it.
+// command_list -
+//    The whole table, as returned by command_names, for code that
+//    needs to list every command.
+
+struct command_entry {
+   string_view name;
+   command_info info;
+};
+
+struct command_list {
+   const command_entry* first;
+   size_t count;
+   const command_entry* begin() const {return first;}
+   const command_entry* end() const {return first + count;}
+};
+
+command_list command_names();
 
 // command_error -
 //    Extend runtime_error for throwing exceptions related to this 
@@ -27,21 +65,54 @@ class command_error: public runtime_error {
 
 // execution functions -
 
-void fn_comm   (inode_state& state, const wordvec& words);
-void fn_cat    (inode_state& state, const wordvec& words);
-void fn_cd     (inode_state& state, const wordvec& words);
-void fn_echo   (inode_state& state, const wordvec& words);
-void fn_exit   (inode_state& state, const wordvec& words);
-void fn_ls     (inode_state& state, const wordvec& words);
-void fn_lsr    (inode_state& state, const wordvec& words);
-void fn_make   (inode_state& state, const wordvec& words);
-void fn_mkdir  (inode_state& state, const wordvec& words);
-void fn_prompt (inode_state& state, const wordvec& words);
-void fn_pwd    (inode_state& state, const wordvec& words);
-void fn_rm     (inode_state& state, const wordvec& words);
-void fn_rmr    (inode_state& state, const wordvec& words);
-
-command_fn find_command_fn (const string& command);
+void fn_comm   (inode_state& state, word_span words);
+void fn_append (inode_state& state, word_span words);
+void fn_cat    (inode_state& state, word_span words);
+void fn_cd     (inode_state& state, word_span words);
+void fn_compact(inode_state& state, word_span words);
+void fn_echo   (inode_state& state, word_span words);
+void fn_exit   (inode_state& state, word_span words);
+void fn_export (inode_state& state, word_span words);
+void fn_import (inode_state& state, word_span words);
+void fn_load   (inode_state& state, word_span words);
+void fn_ls     (inode_state& state, word_span words);
+void fn_lsr    (inode_state& state, word_span words);
+void fn_make   (inode_state& state, word_span words);
+void fn_mkdir  (inode_state& state, word_span words);
+void fn_prompt (inode_state& state, word_span words);
+void fn_pwd    (inode_state& state, word_span words);
+void fn_rm     (inode_state& state, word_span words);
+void fn_rmr    (inode_state& state, word_span words);
+void fn_save   (inode_state& state, word_span words);
+void fn_stats  (inode_state& state, word_span words);
+
+// find_command -
+//    Looks a command up in a perfect hash table built at compile
+//    time:  a hash of the name's length and its first, second and
+//    last bytes picks the only slot it could be in, and one compare
+//    of the name settles it.  Nothing is allocated.  Throws a
+//    command_error for an unknown command.
+
+const command_info& find_command (string_view command);
+command_fn find_command_fn (string_view command);
+
+// run_command -
+//    Runs a command found by find_command on the words of a line and
+//    records how long it took in the session's stats.  A command that
+//    throws anything but ysh_exit counts as failed, and the exception
+//    is passed on.  Locking and the journal are left to the caller.
+
+void run_command (inode_state& state, const command_info& command,
+                  word_span words);
+
+// run_locked -
+//    run_command for a session on a tree that other sessions share.
+//    Holds the tree's lock exclusively if the command needs the tree
+//    to itself, and shared otherwise, in which case the directories
+//    and files lock themselves as the command goes.
+
+void run_locked (inode_state& state, const command_info& command,
+                 word_span words);
 
 // exit_status_message -
 //    Prints an exit message and returns the exit status, as recorded
@@ -20,14 +20,6 @@ void debugflags::setflags (const string& initflags) {
    }
 }
 
-// getflag -
-//    Check to see if a certain flag is on.
-
-bool debugflags::getflag (char flag) {
-   // WARNING: Don't TRACE this function or the stack will blow up.
-   return flags.test (static_cast<unsigned char> (flag));
-}
-
 void debugflags::where (char flag, const char* file, int line,
                         const char* func) {
    cout << execname() << ": DEBUG(" << flag << ") "
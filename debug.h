@@ -17,7 +17,8 @@ using namespace std;
 //    Takes a string argument, and sets a flag for each char in the
 //    string.  As a special case, '@', sets all flags.
 // getflag -
-//    Used by the DEBUGF macro to check to see if a flag has been set.
+//    Used by the DEBUGF and TRACE macros to check to see if a flag
+//    has been set.  Inline, since TRACE checks it on hot paths.
 //    Not to be called by user code.
 
 class debugflags {
@@ -26,7 +27,10 @@ class debugflags {
       static flagset flags;
    public:
       static void setflags (const string& optflags);
-      static bool getflag (char flag);
+      static bool getflag (char flag) {
+         // WARNING: Don't TRACE this function or the stack will blow up.
+         return flags.test (static_cast<unsigned char> (flag));
+      }
       static void where (char flag, const char* file, int line,
                          const char* func);
 };
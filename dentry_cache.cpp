@@ -0,0 +1,111 @@
+// $Id: dentry_cache.cpp,v 1.1 2016-03-19 14:02:10-07 - - $
+// Partner: Darius Sakhapour(dsakhapo@ucsc.edu)
+// Partner: Ryan Wong (rystwong@ucsc.edu)
+
+#include <iomanip>
+#include <iostream>
+
+using namespace std;
+
+#include "dentry_cache.h"
+#include "file_sys.h"
+#include "trace.h"
+
+// Approximate heap cost of one entry:  the hash node with its key
+// and value, the spilled part of the key, and the trail.
+size_t dentry_cache::entry_bytes (const string& path,
+                                  const entry& cached) {
+   size_t total = sizeof (void*) * 2 + sizeof (string) + sizeof (entry);
+   if (path.capacity() > 15) total += path.capacity() + 1;
+   if (cached.name.capacity() > 15) total += cached.name.capacity() + 1;
+   total += cached.walked.capacity() * sizeof (step);
+   return total;
+}
+
+bool dentry_cache::find (const inode_ptr& start, string_view path,
+                         resolved_path& result) {
+   auto paths = starts.find (start->get_inode_nr());
+   if (paths != starts.end()) {
+      probe.assign (path);
+      auto found = paths->second.find (probe);
+      if (found != paths->second.end()) {
+         const entry& cached = found->second;
+         bool valid = true;
+         for (const step& walked: cached.walked) {
+            inode_ptr dir = walked.dir.lock();
+            if (dir == nullptr or dir->get_contents()->get_generation()
+                                  != walked.generation) {
+               valid = false;
+               break;
+            }
+         }
+         if (valid) {
+            result.parent = cached.parent.lock();
+            result.target = cached.target.lock();
+            valid = (result.parent != nullptr) == cached.has_parent
+                and (result.target != nullptr) == cached.has_target;
+         }
+         if (valid) {
+            result.name = cached.name;
+            ++hits;
+            return true;
+         }
+         // Left in place for the insert that follows the new walk.
+         TRACE ('d', "stale: %", path);
+         result = resolved_path();
+         ++stale;
+      }
+   }
+   ++misses;
+   return false;
+}
+
+void dentry_cache::insert (const inode_ptr& start, string_view path,
+                           const resolved_path& result,
+                           trail&& walked) {
+   if (capacity == 0) return;
+   if (entries >= capacity) clear();
+   entry cached {move (walked), result.parent, result.target,
+                 result.parent != nullptr, result.target != nullptr,
+                 result.name};
+   path_map& paths = starts[start->get_inode_nr()];
+   probe.assign (path);
+   auto found = paths.find (probe);
+   if (found != paths.end()) {
+      bytes -= entry_bytes (found->first, found->second);
+      found->second = move (cached);
+   }else {
+      found = paths.emplace (probe, move (cached)).first;
+      ++entries;
+   }
+   bytes += entry_bytes (found->first, found->second);
+}
+
+void dentry_cache::clear() {
+   TRACE ('d', "clearing % entries", entries);
+   starts.clear();
+   entries = 0;
+   bytes = 0;
+}
+
+void dentry_cache::set_capacity (size_t new_capacity) {
+   capacity = new_capacity;
+   if (entries > capacity) clear();
+}
+
+double dentry_cache::hit_rate() const {
+   size_t lookups = hits + misses;
+   return lookups == 0 ? 0 : static_cast<double> (hits) / lookups;
+}
+
+void dentry_cache::report (ostream& out) const {
+   ios_base::fmtflags flags = out.flags();
+   streamsize precision = out.precision();
+   out << "dentry cache: " << hits << " hits, " << misses
+       << " misses (" << stale << " stale), hit rate "
+       << fixed << setprecision (1) << hit_rate() * 100 << "%, "
+       << entries << " entries, " << bytes << " bytes" << endl;
+   out.flags (flags);
+   out.precision (precision);
+}
+
@@ -0,0 +1,85 @@
+// $Id: dentry_cache.h,v 1.1 2016-03-19 14:02:10-07 - - $
+// Partner: Darius Sakhapour(dsakhapo@ucsc.edu)
+// Partner: Ryan Wong (rystwong@ucsc.edu)
+
+#ifndef __DENTRY_CACHE_H__
+#define __DENTRY_CACHE_H__
+
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+class inode;
+using inode_ptr = shared_ptr<inode>;
+struct resolved_path;
+
+// dentry_cache -
+//    Remembers how pathnames resolved, keyed by the inode number of
+//    the directory the walk started from and the pathname itself.
+//    Every directory counts changes to its entries in a generation
+//    number, and an entry records the generation of each directory
+//    its walk looked into.  A hit is only used if all of those
+//    directories are still alive and unchanged, so mkdir, make and
+//    rm invalidate exactly the paths that pass through the directory
+//    they touch.  No inode is kept alive by the cache.
+// trail -
+//    The directories consulted during one walk, in order.
+// find -
+//    Fills in result and returns true on a valid hit.  A stale
+//    entry counts as a miss.  The path is copied into probe to look
+//    it up, which reuses probe's buffer rather than allocating.
+// insert -
+//    Records the result of a walk, replacing a stale entry for the
+//    same path.  When the cache is full it is emptied and starts
+//    again.
+// set_capacity -
+//    Bounds the number of entries.  Zero disables the cache.
+// report -
+//    Prints the hit rate, entry count and approximate memory use.
+
+class dentry_cache {
+   public:
+      struct step {
+         weak_ptr<inode> dir;
+         uint64_t generation;
+      };
+      using trail = vector<step>;
+   private:
+      struct entry {
+         trail walked;
+         weak_ptr<inode> parent;
+         weak_ptr<inode> target;
+         bool has_parent;
+         bool has_target;
+         string name;
+      };
+      using path_map = unordered_map<string,entry>;
+      unordered_map<int,path_map> starts;
+      size_t capacity {65536};
+      size_t entries {0};
+      size_t bytes {0};
+      size_t hits {0};
+      size_t misses {0};
+      size_t stale {0};
+      string probe;
+      static size_t entry_bytes (const string& path, const entry&);
+   public:
+      bool find (const inode_ptr& start, string_view path,
+                 resolved_path& result);
+      void insert (const inode_ptr& start, string_view path,
+                   const resolved_path& result, trail&& walked);
+      void clear();
+      void set_capacity (size_t new_capacity);
+      size_t size() const {return entries;}
+      size_t memory() const {return bytes;}
+      double hit_rate() const;
+      void report (ostream& out) const;
+};
+
+#endif
+
@@ -0,0 +1,266 @@
+// $Id: dirents.cpp,v 1.1 2016-03-19 14:02:10-07 - - $
+// Partner: Darius Sakhapour(dsakhapo@ucsc.edu)
+// Partner: Ryan Wong (rystwong@ucsc.edu)
+
+#include <algorithm>
+#include <iostream>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+
+using namespace std;
+
+#include "dirents.h"
+#include "rw_lock.h"
+#include "trace.h"
+
+//        *********************************************
+//        **************** Name Table *****************
+//        *********************************************
+
+// An interned name and the number of inodes using it.  A name_ref
+// points at the string base, so release finds the count without a
+// lookup.
+struct interned_name: string {
+   mutable atomic<size_t> refs {1};
+   explicit interned_name (string_view text): string (text) {}
+};
+
+// One shard of the table, on a cache line of its own.  The keys view
+// the strings they map to, which never move.
+struct alignas (64) name_shard {
+   rw_lock lock;
+   unordered_map<string_view,unique_ptr<interned_name>> names;
+};
+
+// The shards, and the empty name of every new inode and the root,
+// which is never counted or freed.  Neither is ever destroyed, since
+// inodes may still release names during static destruction.
+constexpr size_t shard_count = 64;
+
+static name_shard* shards() {
+   static name_shard* table = new name_shard[shard_count];
+   return table;
+}
+
+static name_shard& shard_of (string_view name) {
+   return shards()[hash<string_view>() (name) % shard_count];
+}
+
+static name_ref empty_name() {
+   static const interned_name* empty = new interned_name ("");
+   return empty;
+}
+
+name_ref name_table::intern (string_view name) {
+   if (name.empty()) return empty_name();
+   name_shard& shard = shard_of (name);
+   {
+      shared_lock<rw_lock> guard (shard.lock);
+      auto found = shard.names.find (name);
+      if (found != shard.names.end()) {
+         found->second->refs.fetch_add (1, memory_order_relaxed);
+         return found->second.get();
+      }
+   }
+   unique_lock<rw_lock> guard (shard.lock);
+   auto found = shard.names.find (name);
+   if (found != shard.names.end()) {
+      found->second->refs.fetch_add (1, memory_order_relaxed);
+      return found->second.get();
+   }
+   auto added = make_unique<interned_name> (name);
+   string_view key = *added;
+   return shard.names.emplace (key, move (added)).first->second.get();
+}
+
+void name_table::hold (name_ref name) {
+   if (name == empty_name()) return;
+   static_cast<const interned_name*> (name)->refs.fetch_add (
+         1, memory_order_relaxed);
+}
+
+// Uses other than the last are dropped without the lock.  The last
+// is dropped under the shard's unique lock, which keeps intern from
+// finding the name and counting a new use of it while it is freed.
+void name_table::release (name_ref name) {
+   if (name == empty_name()) return;
+   auto interned = static_cast<const interned_name*> (name);
+   size_t refs = interned->refs.load (memory_order_relaxed);
+   while (refs > 1) {
+      if (interned->refs.compare_exchange_weak (refs, refs - 1,
+                                                memory_order_relaxed)) {
+         return;
+      }
+   }
+   name_shard& shard = shard_of (*name);
+   unique_lock<rw_lock> guard (shard.lock);
+   if (interned->refs.fetch_sub (1, memory_order_relaxed) == 1) {
+      shard.names.erase (shard.names.find (*name));
+   }
+}
+
+name_ref name_table::find (string_view name) {
+   if (name.empty()) return empty_name();
+   name_shard& shard = shard_of (name);
+   shared_lock<rw_lock> guard (shard.lock);
+   auto found = shard.names.find (name);
+   return found == shard.names.end() ? nullptr : found->second.get();
+}
+
+size_t name_table::count() {
+   size_t names = 1;
+   for (size_t shard = 0; shard < shard_count; ++shard) {
+      shared_lock<rw_lock> guard (shards()[shard].lock);
+      names += shards()[shard].names.size();
+   }
+   return names;
+}
+
+int compare_names (const string& a, bool a_dir,
+                   const string& b, bool b_dir) {
+   size_t common = min (a.size(), b.size());
+   int cmp = a.compare (0, common, b, 0, common);
+   if (cmp != 0) return cmp;
+   // One is a prefix of the other; what follows it is either the
+   // rest of the longer name, a "/", or nothing.
+   auto next = [common] (const string& name, bool is_dir) {
+      if (name.size() > common) {
+         return static_cast<int> (static_cast<unsigned char>
+                                  (name[common]));
+      }
+      return is_dir ? static_cast<int> ('/') : -1;
+   };
+   // Names never contain "/", so equal next chars mean equal names.
+   return next (a, a_dir) - next (b, b_dir);
+}
+
+//        *********************************************
+//        **************** Dirent Table ***************
+//        *********************************************
+
+// The index refers into the tree it was built for, so a copy gets a
+// fresh index over its own tree.
+dirent_table::dirent_table (const dirent_table& that):
+              small (that.small), large (that.large),
+              is_small (that.is_small) {
+   index.reserve (large.size());
+   for (auto itor = large.cbegin(); itor != large.cend(); ++itor) {
+      index.emplace (itor->name, itor);
+   }
+}
+
+dirent_table& dirent_table::operator= (const dirent_table& that) {
+   if (this != &that) *this = dirent_table (that);
+   return *this;
+}
+
+dirent_table::const_iterator dirent_table::begin() const {
+   const_iterator itor;
+   itor.is_small = is_small;
+   if (is_small) itor.small_itor = small.cbegin();
+            else itor.large_itor = large.cbegin();
+   return itor;
+}
+
+dirent_table::const_iterator dirent_table::end() const {
+   const_iterator itor;
+   itor.is_small = is_small;
+   if (is_small) itor.small_itor = small.cend();
+            else itor.large_itor = large.cend();
+   return itor;
+}
+
+size_t dirent_table::size() const {
+   return is_small ? small.size() : large.size();
+}
+
+// Tiny vectors are scanned comparing interned pointers only; larger
+// ones are binary searched.
+inode_ptr dirent_table::find (name_ref name, bool is_dir) const {
+   if (is_small) {
+      if (small.size() <= 8) {
+         for (const dirent& entry: small) {
+            if (entry.name == name and entry.is_dir == is_dir) {
+               return entry.node;
+            }
+         }
+         return nullptr;
+      }
+      auto found = lower_bound (small.cbegin(), small.cend(),
+                                dirent {name, is_dir, nullptr}, order());
+      if (found != small.cend() and found->name == name
+          and found->is_dir == is_dir) return found->node;
+      return nullptr;
+   }
+   auto found = index.find (name);
+   if (found == index.end() or found->second->is_dir != is_dir) {
+      return nullptr;
+   }
+   return found->second->node;
+}
+
+bool dirent_table::insert (name_ref name, bool is_dir,
+                           const inode_ptr& node) {
+   dirent entry {name, is_dir, node};
+   if (not is_small) {
+      if (index.count (name) != 0) return false;
+      index.emplace (name, large.insert (move (entry)).first);
+      return true;
+   }
+   if (find (name, not is_dir) != nullptr) return false;
+   auto place = lower_bound (small.begin(), small.end(), entry, order());
+   if (place != small.end() and place->name == name
+       and place->is_dir == is_dir) return false;
+   small.insert (place, move (entry));
+   if (small.size() > small_limit) grow();
+   return true;
+}
+
+bool dirent_table::erase (name_ref name, bool is_dir) {
+   dirent probe {name, is_dir, nullptr};
+   if (not is_small) {
+      auto found = index.find (name);
+      if (found == index.end() or found->second->is_dir != is_dir) {
+         return false;
+      }
+      large.erase (found->second);
+      index.erase (found);
+      if (large.size() <= small_limit / 2) shrink();
+      return true;
+   }
+   auto place = lower_bound (small.begin(), small.end(), probe, order());
+   if (place == small.end() or place->name != name
+       or place->is_dir != is_dir) return false;
+   small.erase (place);
+   return true;
+}
+
+void dirent_table::clear() {
+   small.clear();
+   index.clear();
+   large.clear();
+   is_small = true;
+}
+
+void dirent_table::grow() {
+   index.reserve (small.size() * 2);
+   for (dirent& entry: small) {
+      name_ref name = entry.name;
+      index.emplace (name, large.insert (large.end(), move (entry)));
+   }
+   small.clear();
+   small.shrink_to_fit();
+   is_small = false;
+   TRACE ('m', "dirent table grown to %", large.size());
+}
+
+void dirent_table::shrink() {
+   small.reserve (large.size());
+   for (const dirent& entry: large) small.push_back (entry);
+   index.clear();
+   large.clear();
+   is_small = true;
+   TRACE ('m', "dirent table shrunk to %", small.size());
+}
+
@@ -0,0 +1,156 @@
+// $Id: dirents.h,v 1.1 2016-03-19 14:02:10-07 - - $
+// Partner: Darius Sakhapour(dsakhapo@ucsc.edu)
+// Partner: Ryan Wong (rystwong@ucsc.edu)
+
+#ifndef __DIRENTS_H__
+#define __DIRENTS_H__
+
+#include <memory>
+#include <set>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+#include "pool.h"
+
+class inode;
+using inode_ptr = shared_ptr<inode>;
+
+// name_table -
+//    Interns file names.  Every inode and dirent with the same name
+//    shares one immutable string, so names cost memory once however
+//    many files carry them, and two interned names are equal exactly
+//    when their pointers are.  Names are stored bare, without the
+//    trailing "/" that directories print with.  Each name counts the
+//    inodes that use it and is freed with the last of them.  The
+//    table is split into shards by hash, each with a lock of its
+//    own, so lookups of different names seldom meet on one lock.
+// intern -
+//    Returns the shared copy of a name, adding it if needed, and
+//    counts one more use of it.
+// hold -
+//    Counts one more use of a name already interned.
+// release -
+//    Counts one use fewer, freeing the name after its last use.
+// find -
+//    Returns the shared copy, or nullptr if no file has the name, in
+//    which case no directory can contain it.  Takes a view so a path
+//    component can be looked up without being copied out.  No use is
+//    counted, so the result is only good while a holder of the name
+//    is known to keep it, as a directory's entries do under its lock.
+// count -
+//    The number of names in the table.
+
+using name_ref = const string*;
+
+class name_table {
+   public:
+      static name_ref intern (string_view name);
+      static void hold (name_ref name);
+      static void release (name_ref name);
+      static name_ref find (string_view name);
+      static size_t count();
+};
+
+// compare_names -
+//    Orders two names as if each directory name had its "/"
+//    appended, which is the order ls and lsr have always printed.
+
+int compare_names (const string& a, bool a_dir,
+                   const string& b, bool b_dir);
+
+// dirent -
+//    One directory entry:  the interned name, whether it names a
+//    directory (which decides its place in the order), and the
+//    inode it refers to.
+
+struct dirent {
+   name_ref name;
+   bool is_dir;
+   inode_ptr node;
+};
+
+// dirent_table -
+//    The entries of one directory, kept in compare_names order.
+//    The representation adapts to the size of the directory:
+//    small directories hold their entries in a sorted vector, which
+//    is compact and scanned with pointer comparisons; past
+//    small_limit entries the table moves them into a balanced tree
+//    for ordered iteration plus a hash index on the interned name
+//    pointer, so lookups in huge directories are O(1) and do not
+//    chase a pointer per tree level.  It moves them back once it
+//    shrinks to half of small_limit.  Iteration order is the same
+//    in both representations.
+// find -
+//    Returns the inode with this name and type, or nullptr.
+// insert -
+//    Adds an entry, returning false if the name is taken.  A name
+//    is unique within a directory whether it is a file or not.
+// erase -
+//    Removes an entry, returning false if there was none.
+
+class dirent_table {
+   private:
+      struct order {
+         using is_transparent = void;
+         bool operator() (const dirent& a, const dirent& b) const {
+            return compare_names (*a.name, a.is_dir,
+                                  *b.name, b.is_dir) < 0;
+         }
+      };
+      using large_set = set<dirent,order,pool_allocator<dirent>>;
+      using large_index = unordered_map<name_ref,
+               large_set::const_iterator, hash<name_ref>,
+               equal_to<name_ref>,
+               pool_allocator<pair<const name_ref,
+                                   large_set::const_iterator>>>;
+      vector<dirent> small;
+      large_set large;
+      large_index index;
+      bool is_small {true};
+      void grow();
+      void shrink();
+   public:
+      static constexpr size_t small_limit = 64;
+      dirent_table() = default;
+      dirent_table (const dirent_table&);
+      dirent_table (dirent_table&&) = default;
+      dirent_table& operator= (const dirent_table&);
+      dirent_table& operator= (dirent_table&&) = default;
+      class const_iterator {
+         private:
+            friend class dirent_table;
+            bool is_small {true};
+            vector<dirent>::const_iterator small_itor;
+            large_set::const_iterator large_itor;
+         public:
+            const dirent& operator*() const {
+               return is_small ? *small_itor : *large_itor;
+            }
+            const dirent* operator->() const { return &**this; }
+            const_iterator& operator++() {
+               if (is_small) ++small_itor; else ++large_itor;
+               return *this;
+            }
+            bool operator== (const const_iterator& that) const {
+               return is_small ? small_itor == that.small_itor
+                               : large_itor == that.large_itor;
+            }
+            bool operator!= (const const_iterator& that) const {
+               return not (*this == that);
+            }
+      };
+      const_iterator begin() const;
+      const_iterator end() const;
+      size_t size() const;
+      bool empty() const { return size() == 0; }
+      inode_ptr find (name_ref name, bool is_dir) const;
+      bool insert (name_ref name, bool is_dir, const inode_ptr& node);
+      bool erase (name_ref name, bool is_dir);
+      void clear();
+};
+
+#endif
+
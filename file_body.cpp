@@ -0,0 +1,63 @@
+// $Id: file_body.cpp,v 1.2 2016-03-19 14:02:10-07 - - $
+// Partner: Darius Sakhapour(dsakhapo@ucsc.edu)
+// Partner: Ryan Wong (rystwong@ucsc.edu)
+
+#include <algorithm>
+
+using namespace std;
+
+#include "file_body.h"
+
+void file_body::append_word (string_view word) {
+   if (chunks.empty()
+       or chunks.back().bytes.size() + word.size() >= chunk_bytes) {
+      chunks.emplace_back();
+   }
+   chunk& last = chunks.back();
+   last.bytes.append (word);
+   last.ends.push_back (last.bytes.size());
+   last.bytes.push_back (' ');
+   chars += word.size();
+   ++words;
+}
+
+// Starts the first chunk with room for a body that fits in one,
+// so it is filled without reallocating.
+void file_body::reserve_first (size_t bytes, size_t count) {
+   if (bytes >= chunk_bytes) return;
+   chunks.emplace_back();
+   chunks.back().bytes.reserve (bytes);
+   chunks.back().ends.reserve (count);
+}
+
+// A short text going into an empty body is sized exactly up front,
+// which is the common case when a host file is imported.
+void file_body::append_text (string_view text) {
+   if (chunks.empty() and not text.empty()) {
+      reserve_first (text.size(), count (text.begin(), text.end(), ' '));
+   }
+   constexpr string_view separators {" \t\n"};
+   size_t start = 0;
+   while (start < text.size()) {
+      size_t end = text.find_first_of (separators, start);
+      if (end == string_view::npos) end = text.size();
+      if (end > start) append_word (text.substr (start, end - start));
+      start = end + 1;
+   }
+}
+
+void file_body::clear() {
+   chunks.clear();
+   words = 0;
+   chars = 0;
+}
+
+wordvec file_body::to_wordvec() const {
+   wordvec result;
+   result.reserve (words);
+   for_each_word ([&result] (string_view word) {
+      result.emplace_back (word);
+   });
+   return result;
+}
+
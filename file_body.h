@@ -0,0 +1,107 @@
+// $Id: file_body.h,v 1.2 2016-03-19 14:02:10-07 - - $
+// Partner: Darius Sakhapour(dsakhapo@ucsc.edu)
+// Partner: Ryan Wong (rystwong@ucsc.edu)
+
+#ifndef __FILE_BODY_H__
+#define __FILE_BODY_H__
+
+#include <cstdint>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+using namespace std;
+
+#include "util.h"
+
+// file_body -
+//    The words of a plain file, held as a rope of chunks.  Each
+//    chunk is one contiguous byte buffer holding its words exactly
+//    as cat prints them, each followed by a space, plus a table of
+//    the offset at which each word ends.  A chunk grows to about
+//    chunk_bytes and then a new one is started, so words already in
+//    the file are never copied wholesale and an append costs
+//    O(appended size).  A word costs its bytes plus five, instead of
+//    a string object and possibly a heap block of its own.
+// assign -
+//    Replaces the body with a range of words.
+// append -
+//    Adds a range of words at the end.  Words going into an empty
+//    body from a random access range are sized up front, as when a
+//    snapshot is loaded.
+// append_text -
+//    Adds the words of a text in which they are separated by runs
+//    of spaces, tabs and newlines:  the bytes for_each_chunk hands
+//    out, or a host file split into words line by line the way a
+//    command line is.
+// for_each_word -
+//    Calls a function with a view of each word in order.
+// for_each_chunk -
+//    Calls a function with each chunk's bytes, which are the words
+//    separated and followed by single spaces.  Used by cat to write
+//    a body with one write per chunk.
+// to_wordvec -
+//    Compatibility path for code that wants the words as a single
+//    wordvec.  Copies the whole body.
+
+class file_body {
+   public:
+      static constexpr size_t chunk_bytes = 64 * 1024;
+   private:
+      struct chunk {
+         string bytes;
+         vector<uint32_t> ends;
+      };
+      vector<chunk> chunks;
+      size_t words {0};
+      size_t chars {0};   // Sum of the word lengths.
+      void append_word (string_view word);
+      void reserve_first (size_t bytes, size_t count);
+   public:
+      template <typename iterator>
+      void assign (iterator begin, iterator end) {
+         clear();
+         append (begin, end);
+      }
+      template <typename iterator>
+      void append (iterator begin, iterator end) {
+         if constexpr (is_base_of_v<random_access_iterator_tag,
+                       typename iterator_traits<iterator>::
+                       iterator_category>) {
+            if (chunks.empty() and begin != end) {
+               size_t bytes = 0;
+               for (iterator word = begin; word != end; ++word) {
+                  bytes += string_view (*word).size() + 1;
+               }
+               reserve_first (bytes, end - begin);
+            }
+         }
+         for (; begin != end; ++begin) append_word (*begin);
+      }
+      void append_text (string_view text);
+      template <typename func_t>
+      void for_each_word (func_t func) const {
+         for (const chunk& piece: chunks) {
+            uint32_t start = 0;
+            for (uint32_t end: piece.ends) {
+               func (string_view (piece.bytes).substr (start,
+                                                       end - start));
+               start = end + 1;
+            }
+         }
+      }
+      template <typename func_t>
+      void for_each_chunk (func_t func) const {
+         for (const chunk& piece: chunks) {
+            func (piece.bytes.data(), piece.bytes.size());
+         }
+      }
+      void clear();
+      size_t word_count() const { return words; }
+      size_t char_count() const { return chars; }
+      wordvec to_wordvec() const;
+};
+
+#endif
+
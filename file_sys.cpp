@@ -2,16 +2,23 @@
 // Partner: Darius Sakhapour(dsakhapo@ucsc.edu)
 // Partner: Ryan Wong (rystwong@ucsc.edu)
 
+#include <algorithm>
 #include <iostream>
 #include <stdexcept>
 #include <unordered_map>
 #include <iomanip>
+#include <sstream>
 using namespace std;
 
 #include "debug.h"
 #include "file_sys.h"
 #include "commands.h"
-int inode::next_inode_nr {1};
+#include "pool.h"
+#include "thread_pool.h"
+#include "trace.h"
+atomic<int> inode::next_inode_nr {1};
+atomic<size_t> inode::live_inodes {0};
+atomic<size_t> inode::created_inodes {0};
 
 //        *********************************************
 //        ************** Misc. Functions **************
@@ -37,26 +44,163 @@ ostream& operator<< (ostream& out, const inode_state& state) {
    return out;
 }
 
+// Inodes and their contents come from the slab pools, each as one
+// block holding both the object and its shared_ptr control block.
+inode_ptr new_inode(file_type type) {
+   return allocate_shared<inode>(pool_allocator<inode>(), type);
+}
+
 file_error::file_error (const string& what):
             runtime_error (what) {
 }
 
-void lsr(inode_ptr& dir){
-   map<string, inode_ptr> dirents = dir->contents->get_contents();
-   cout << dir->get_name() << ":" << endl;
-   for (auto i = dirents.cbegin(); i != dirents.cend(); ++i) {
-      cout << setw(6) << i->second->get_inode_nr() << "  " << setw(6)
-               << i->second->contents->size() << "  " << i->first
-               << endl;
+// Prints one line per dirent of a directory: inode number, size,
+// and name.  Shared by ls and lsr.
+// Dot and dotdot are not stored in the map, so they are merged into
+// their lexicographic place as the map is walked.  Their sizes are
+// taken before the directory is locked, since dot is the directory
+// itself, and so is dotdot at the root.
+void print_dirents(const inode_ptr& dir, ostream& out) {
+   auto print = [&out](const string& name, bool is_dir,
+                       const inode_ptr& node, size_t size) {
+      out << setw(6) << node->get_inode_nr() << "  " << setw(6)
+          << size << "  " << name << (is_dir ? "/" : "") << endl;
+   };
+   static const string dot_names[] {".", ".."};
+   const inode_ptr dots[] {dir, dir->contents->lookup("..", false)};
+   size_t dot_sizes[2] {};
+   for (size_t dot = 0; dot < 2; ++dot) {
+      if (dots[dot] == nullptr) continue;
+      dot_sizes[dot] = dots[dot]->contents->size();
+   }
+   size_t next_dot = 0;
+   auto print_dots_before = [&](const dirent* entry) {
+      for (; next_dot < 2; ++next_dot) {
+         if (entry != nullptr and compare_names(dot_names[next_dot],
+                   false, *entry->name, entry->is_dir) > 0) break;
+         if (dots[next_dot] != nullptr) {
+            print(dot_names[next_dot], false, dots[next_dot],
+                  dot_sizes[next_dot]);
+         }
+      }
+   };
+   auto guard = dir->contents->read_lock();
+   for (const dirent& entry: dir->contents->get_dirents()) {
+      print_dots_before(&entry);
+      print(*entry.name, entry.is_dir, entry.node,
+            entry.node->contents->size());
+   }
+   print_dots_before(nullptr);
+}
+
+// One directory's part of the lsr output.
+static void print_listing(const inode_ptr& dir,
+                          const lsr_options& options, ostream& out) {
+   if (options.counts_only) {
+      out << dir->get_name() << ": " << dir->get_contents()->size()
+          << endl;
+   }else {
+      out << dir->get_name() << ":" << endl;
+      print_dirents(dir, out);
+   }
+}
+
+// Visits a directory and every directory below it, in pre-order with
+// children taken lexicographically.  The walk keeps an explicit stack
+// with one frame per level, each holding the subdirectories of that
+// level, so memory grows with the depth of the tree and the number
+// of subdirectories, not with the number of files.  The
+// subdirectories are copied out under the directory's lock, so no
+// lock is held while the tree below is visited.
+template <typename visit_fn>
+static void walk_dirs(const inode_ptr& top, size_t max_depth,
+                      visit_fn visit) {
+   struct frame {
+      vector<inode_ptr> subdirs;
+      size_t next;
+   };
+   vector<frame> stack;
+   auto enter = [&](const inode_ptr& dir) {
+      visit(dir);
+      if (stack.size() < max_depth) {
+         stack.push_back({{}, 0});
+         auto guard = dir->get_contents()->read_lock();
+         for (const dirent& entry: dir->get_contents()->get_dirents()) {
+            if (entry.is_dir) stack.back().subdirs.push_back(entry.node);
+         }
+      }
+   };
+   enter(top);
+   while (not stack.empty()) {
+      frame& level = stack.back();
+      if (level.next == level.subdirs.size()) {
+         stack.pop_back();
+         continue;
+      }
+      inode_ptr child = move(level.subdirs[level.next++]);
+      enter(child);
    }
-   for(auto i = dirents.begin(); i != dirents.end(); ++i){
-       if(i->first.compare(".") == 0 or i->first.compare("..") == 0);
-       else{
-          if(i->second->contents->is_dir()){
-             lsr(i->second);
-          }
-       }
-    }
+}
+
+// Parallel lsr.  Directories are gathered in pre-order into a window,
+// the window is cut into chunks of roughly equal entry counts, and the
+// chunks are formatted concurrently on the pool.  The formatted chunks
+// are then written in order, so the output is exactly that of the
+// sequential walk.
+static void parallel_lsr(const inode_ptr& top,
+                         const lsr_options& options, ostream& out) {
+   constexpr size_t window_size = 4096;
+   thread_pool pool(options.threads);
+   vector<inode_ptr> window;
+   size_t window_entries = 0;
+   auto flush_window = [&]() {
+      size_t chunk_entries = window_entries / (pool.size() * 4) + 1;
+      vector<pair<size_t, size_t>> chunks;
+      size_t begin = 0, entries = 0;
+      for (size_t i = 0; i < window.size(); ++i) {
+         entries += window[i]->get_contents()->size();
+         if (entries >= chunk_entries or i + 1 == window.size()) {
+            chunks.emplace_back(begin, i + 1);
+            begin = i + 1;
+            entries = 0;
+         }
+      }
+      vector<string> text(chunks.size());
+      for (size_t c = 0; c < chunks.size(); ++c) {
+         pool.submit([&, c]() {
+            ostringstream chunk_out;
+            for (size_t i = chunks[c].first; i < chunks[c].second; ++i) {
+               print_listing(window[i], options, chunk_out);
+            }
+            text[c] = chunk_out.str();
+         });
+      }
+      pool.wait();
+      for (const string& chunk: text) out << chunk;
+      window.clear();
+      window_entries = 0;
+   };
+   walk_dirs(top, options.max_depth, [&](const inode_ptr& dir) {
+      window.push_back(dir);
+      window_entries += dir->get_contents()->size();
+      if (window.size() == window_size) flush_window();
+   });
+   if (not window.empty()) flush_window();
+   out.flush();
+}
+
+// Lists a directory and every directory below it, writing each
+// directory's listing as it is found.  With more than one thread the
+// listings are formatted in parallel but written in the same order.
+void lsr(const inode_ptr& top, const lsr_options& options,
+         ostream& out){
+   if (options.threads > 1) {
+      parallel_lsr(top, options, out);
+      return;
+   }
+   walk_dirs(top, options.max_depth, [&](const inode_ptr& dir) {
+      print_listing(dir, options, out);
+   });
 }
 
 //        ***************************************************
@@ -67,34 +211,155 @@ void lsr(inode_ptr& dir){
 // After the constructor is called, the root directory is created here.
 // Thus, the cwd and parent both refer to the root, since this new
 // directory is the root and the root's parent is itself.
-inode_state::inode_state() {
-   root = make_shared<inode>(file_type::DIRECTORY_TYPE);
+inode_state::inode_state(): tree(make_shared<shared_tree>()) {
+   root = new_inode(file_type::DIRECTORY_TYPE);
    cwd = root; parent = root;
    root->contents->set_dir(cwd, parent);
-   root->set_name("/");
+   root->set_name("");
+   tree->root = root;
+   join_tree();
    DEBUGF ('i', "root = " << root << ", cwd = " << cwd
           << ", prompt = \"" << prompt() << "\"");
 }
 
-// Shows the prompt character in console.
-const string& inode_state::prompt() { return prompt_; }
+// A session on a tree that already exists starts at its root.
+inode_state::inode_state(const shared_ptr<shared_tree>& tree_):
+            tree(tree_) {
+   join_tree();
+   DEBUGF ('i', "session on root = " << root << ", "
+          << tree->sessions.size() << " sessions");
+}
 
-void inode_state::print_path(const inode_ptr& curr_dir) const {
-   vector<string> path;
-   path.push_back(curr_dir->get_name());
-   map<string, inode_ptr> dirents = curr_dir->contents->get_contents();
-   inode_ptr parent = dirents.at("..");
-   while(parent->get_inode_nr() > 1){
-      path.push_back(parent->get_name());
-      map<string, inode_ptr> dirents = parent->contents->get_contents();
-      parent = dirents.at("..");
+// The root is read under the lock, since a load in another session
+// may be replacing it.
+void inode_state::join_tree() {
+   unique_lock<shared_mutex> guard(tree->lock);
+   root = tree->root;
+   cwd = root; parent = root;
+   tree->sessions.push_back(this);
+}
+
+// Dropping the last session on a tree frees the tree, which happens
+// under the lock like any other change to it.
+inode_state::~inode_state() {
+   unique_lock<shared_mutex> guard(tree->lock);
+   auto self = find(tree->sessions.begin(), tree->sessions.end(), this);
+   if (self != tree->sessions.end()) tree->sessions.erase(self);
+   cwd.reset();
+   parent.reset();
+   root.reset();
+}
+
+// Moves the session onto a new tree, forgetting every path it had
+// resolved in the old one.
+void inode_state::move_to_root(const inode_ptr& new_root) {
+   root = new_root;
+   parent = new_root;
+   set_cwd(new_root);
+   dentries.clear();
+}
+
+// Shows the prompt character in console.
+const string& inode_state::prompt() const { return prompt_; }
+
+// Single path walker used by every command.
+// Absolute paths start at the root, all others at the given directory.
+// Each intermediate component must name a directory; "." and ".." are
+// followed through the directory's own dirents.  Every step is one
+// O(log n) map lookup with no copying of the dirent map.
+// Walks that succeed are remembered in the dentry cache along with the
+// generation of each directory looked into, so repeating a path costs
+// one hash lookup plus a generation check per level.
+resolved_path inode_state::resolve
+(const inode_ptr& start, string_view pathname) const {
+   resolved_path result;
+   if (dentries.find(start, pathname, result)) return result;
+   static thread_local vector<string_view> path_name;
+   split_views(pathname, slashes, path_name);
+   dentry_cache::trail walked;
+   walked.reserve(path_name.size());
+   auto look_in = [&walked](const inode_ptr& dir) {
+      walked.push_back({dir, dir->contents->get_generation()});
+   };
+   inode_ptr dir = (not pathname.empty() and pathname[0] == '/')
+                 ? root : start;
+   if (path_name.empty()) {
+      result.parent = dir->contents->lookup("..", false);
+      result.target = dir;
+      stats.record_walk(0);
+      dentries.insert(start, pathname, result, move(walked));
+      return result;
+   }
+   for (size_t i = 0; i + 1 < path_name.size(); ++i) {
+      string_view comp = path_name[i];
+      look_in(dir);
+      inode_ptr next = dir->contents->lookup(comp, true);
+      if (next == nullptr) {
+         stats.record_walk(walked.size());
+         throw command_error(string(pathname) + ": invalid pathname");
+      }
+      dir = next;
    }
-   for(auto i = path.cend() - 1; i != path.cbegin() - 1; --i){
-      //if(i == path.cend() - 1) cout << *i;
-      //else if(i > path.cbegin()) cout << *i << "/";
-      cout << *i;
+   look_in(dir);
+   stats.record_walk(walked.size());
+   result.name = path_name.back();
+   if (result.name == "." or result.name == "..") {
+      result.target = dir->contents->lookup(result.name, false);
+      if (result.target == nullptr) {
+         throw command_error(string(pathname) + ": invalid pathname");
+      }
+      result.parent = result.target->contents->lookup("..", false);
+   } else {
+      result.parent = dir;
+      result.target = dir->contents->lookup(result.name, true);
+      if (result.target == nullptr) {
+         result.target = dir->contents->lookup(result.name, false);
+      }
+   }
+   dentries.insert(start, pathname, result, move(walked));
+   TRACE ('i', "% -> inode %", pathname,
+          result.target == nullptr ? 0 : result.target->inode_nr);
+   return result;
+}
+
+void inode_state::set_cwd(inode_ptr new_cwd) {
+   cwd = new_cwd;
+   cwd_path_valid = false;
+}
+
+// Builds the printed path of a directory by climbing its .. links,
+// which are direct pointers to the parent.
+string inode_state::path_of(const inode_ptr& dir) const {
+   vector<name_ref> names;
+   size_t length = 0;
+   for (inode_ptr up = dir; up != nullptr and up != root;
+        up = up->contents->lookup("..", false)) {
+      names.push_back(up->get_name_ref());
+      length += names.back()->size() + 1;
    }
-   cout << endl;
+   if (names.empty()) return "/";
+   string path;
+   path.reserve(length);
+   for (auto name = names.crbegin(); name != names.crend(); ++name) {
+      path += **name;
+      path += '/';
+   }
+   return path;
+}
+
+const string& inode_state::cwd_pathname() const {
+   if (not cwd_path_valid) {
+      cwd_path = path_of(cwd);
+      cwd_path_valid = true;
+      TRACE ('i', "cwd path = %", cwd_path);
+   }
+   return cwd_path;
+}
+
+// Prints the path of a directory.  The cwd's path is cached.
+void inode_state::print_path(const inode_ptr& curr_dir) const {
+   if (curr_dir != cwd) out() << path_of(curr_dir) << endl;
+                   else out() << cwd_pathname() << endl;
 }
 
 // Prints the directory after being called by ls and lsr.
@@ -105,293 +370,202 @@ void inode_state::print_path(const inode_ptr& curr_dir) const {
 // size, and the name of the contents (directory or plain file) inside
 // in that order.
 void inode_state::print_directory
-(const inode_ptr& curr_dir, const wordvec& args) const {
-   map<string, inode_ptr> dirents = curr_dir->contents->get_contents();
+(const inode_ptr& curr_dir, word_span args) const {
    if(args.size() == 1){
-      cout << curr_dir->get_name() << ":" << endl;
-      for(auto i = dirents.cbegin(); i != dirents.cend(); ++i){
-         cout << setw(6) << i->second->get_inode_nr() << "  " << setw(6)
-             << i->second->contents->size() << "  " << i->first << endl;
-      }
+      out() << curr_dir->get_name() << ":" << endl;
+      print_dirents(curr_dir, out());
    }
    else{
-      wordvec path_name = split(args.at(1), "/");
-      inode_ptr ls_dir = curr_dir; bool dir_found = false;
-      for(size_t i = 0; i < path_name.size(); ++i){
-         dir_found = false;
-         for(auto j = dirents.cbegin(); j != dirents.cend(); ++j){
-            if(j->first == path_name.at(i) + "/"){
-               ls_dir = j->second;
-               dir_found = true;
-            }
-            else if(path_name.at(0) == j->first){
-               ls_dir = j->second;
-               dir_found = true;
-               break;
-            }
-         }
-         if(dir_found == false){
-            throw command_error("print_directory: invalid pathname");
-         }
-         dirents = ls_dir->contents->get_contents();
+      inode_ptr ls_dir = resolve(curr_dir, args.at(1)).target;
+      if(ls_dir == nullptr or not ls_dir->contents->is_dir()){
+         throw command_error("print_directory: invalid pathname");
       }
       string name_fix = ls_dir->get_name();
       name_fix.pop_back();
       name_fix = "/" + name_fix;
-      cout << name_fix << ":" << endl;
-      for (auto i = dirents.cbegin(); i != dirents.cend(); ++i) {
-         cout << setw(6) << i->second->get_inode_nr() << "  " << setw(6)
-                  << i->second->contents->size() << "  " << i->first
-                  << endl;
-      }
+      out() << name_fix << ":" << endl;
+      print_dirents(ls_dir, out());
    }
 }
 
 void inode_state::list_recursively
-(inode_state& curr_state, const wordvec& args) {
-   inode_ptr lr; map<string, inode_ptr> dirents;
-   if(args.size() == 1){
-      lr = curr_state.get_cwd();
-      dirents = lr->contents->get_contents();
-      cout << lr->get_name() << ":" << endl;
-      for (auto i = dirents.cbegin(); i != dirents.cend(); ++i) {
-         cout << setw(6) << i->second->get_inode_nr() << "  " << setw(6)
-                  << i->second->contents->size() << "  " << i->first
-                  << endl;
-      }
-      for (auto i = dirents.begin(); i != dirents.end(); ++i) {
-         if (i->first.compare(".") == 0 or i->first.compare("..") == 0)
-            ;
-         else {
-            if (i->second->contents->is_dir()) {
-               lsr(i->second);
-            }
-         }
-      }
-   }
-   else{
-      wordvec path_name = split(args.at(1), "/");
-      string path = args.at(1);
-      path = path.at(0);
-      if (path == "/")
-         lr = root;
-      else
-         lr = curr_state.get_cwd();
-      bool dir_found = false;
-      dirents = lr->contents->get_contents();
-      for (size_t i = 0; i < path_name.size(); ++i) {
-         dir_found = false;
-         for (auto j = dirents.cbegin(); j != dirents.cend(); ++j) {
-            if (j->first == path_name.at(i) + "/") {
-               lr = j->second;
-               dir_found = true;
-            }
-         }
-         if (dir_found == false) {
-            throw command_error("list_recursively: invalid pathname");
-         }
-         dirents = lr->contents->get_contents();
-      }
-      //print top layer dir
-      cout << lr->get_name() << ":" << endl;
-      for (auto i = dirents.cbegin(); i != dirents.cend(); ++i) {
-         cout << setw(6) << i->second->get_inode_nr() << "  " << setw(6)
-                  << i->second->contents->size() << "  " << i->first
-                  << endl;
-      }
-   //Pass in each directory to be recursively listed, from the top layer
-      for (auto i = dirents.begin(); i != dirents.end(); ++i) {
-         if (i->first.compare(".") == 0 or i->first.compare("..") == 0)
-            ;
-         else {
-            if (i->second->contents->is_dir()) {
-               lsr(i->second);
-            }
-         }
+(const inode_ptr& curr_dir, const lsr_options& options) const {
+   inode_ptr lr = curr_dir;
+   if(not options.pathname.empty()){
+      lr = resolve(lr, options.pathname).target;
+      if (lr == nullptr or not lr->contents->is_dir()) {
+         throw command_error("list_recursively: invalid pathname");
       }
    }
+   lsr(lr, options, out());
+}
+
+// A name make, append and mkdir can create.  A quoted word may hold
+// blanks, but a name must not, since snapshots, imports and the
+// journal all split on them.
+static bool creatable_name(const string& name) {
+   return not name.empty() and name != "." and name != ".."
+      and name.find_first_of(" \t") == string::npos;
 }
 
 // Creates a new file for mkfile command, parses out the words to be
 // included in the file itself, then sets the pointers to put the file
 // within the current directory.
+// If the file has the same name as an existing file, the existing
+// file is overwritten in place (keeping its inode number).
 void inode_state::create_file
-(const inode_ptr& curr_dir, const wordvec& words) const {
-   wordvec path_name = split(words.at(1), "/");
-   map<string, inode_ptr> dirents = curr_dir->
-            contents->get_contents();
-   //mk_file points to the dir that the file will be created in
-   inode_ptr mk_file = curr_dir; bool dir_found = false;
-   //same_file points to the duplicate file, if there is one
-   inode_ptr same_file = nullptr; bool file_match = false;
-   for (size_t i = 0; i < path_name.size() - 1; ++i) {
-      dir_found = false;
-      for (auto j = dirents.cbegin(); j != dirents.cend(); ++j) {
-         if (j->first == path_name.at(i) + "/") {
-            mk_file = j->second;
-            dir_found = true;
-         }
-      }
-      if (dir_found == false) {
-         throw command_error("create_file: invalid pathname");
-      }
-      dirents = mk_file->contents->get_contents();
-   }
-   //Check to see if a dir or a file with the same name exists
-   for(auto i = dirents.cbegin(); i != dirents.cend(); ++i){
-      // If the file has the same name as a directory, throw an error.
-      if (i->first == words.at(1) + "/") {
-         throw command_error("create_file: "
-                  "directory has same name");
-         // If the file has the same name as an existing file, replace
-         // the existing file with the new one (including new data).
-      }
-      else if(i->first == words.at(1)){
-         file_match = true;
-         same_file = i->second;
-      }
+(const inode_ptr& curr_dir, word_span words) const {
+   if (words.size() < 2) throw command_error("create_file: no arg");
+   resolved_path path = resolve(curr_dir, words.at(1));
+   if (not creatable_name(path.name)) {
+      throw command_error("create_file: invalid pathname");
    }
-   if(file_match){
-      same_file ->contents->writefile(words);
-      dirents.insert(pair<string, inode_ptr>
-      (same_file->get_name(), same_file));
-      mk_file->contents->set_contents(dirents);
+   // Another session may make the name between the resolve and
+   // here, so a missing file is looked up again as it is created.
+   inode_ptr file = path.target;
+   if (file == nullptr) {
+      file = path.parent->contents->find_or_mkfile(path.name);
    }
-   else{
-      inode_ptr new_file = mk_file->contents->
-                  mkfile(path_name.at(path_name.size() - 1));
-      new_file->contents->writefile(words);
-      dirents.insert(pair<string, inode_ptr>
-      (new_file->get_name(), new_file));
-      mk_file->contents->set_contents(dirents);
+   if (file->contents->is_dir()) {
+      throw command_error("create_file: directory has same name");
+   }
+   file->contents->writefile(words);
+}
+
+// Appends words to a file, creating it if it does not exist.  Only
+// the new words are copied, so a file grown a line at a time costs
+// time proportional to its final size rather than its square.
+void inode_state::append_file
+(const inode_ptr& curr_dir, word_span words) const {
+   if (words.size() < 2) throw command_error("append_file: no arg");
+   resolved_path path = resolve(curr_dir, words.at(1));
+   if (not creatable_name(path.name)) {
+      throw command_error("append_file: invalid pathname");
+   }
+   inode_ptr file = path.target;
+   if (file == nullptr) {
+      file = path.parent->contents->find_or_mkfile(path.name);
    }
+   if (file->contents->is_dir()) {
+      throw command_error("append_file: is a directory");
+   }
+   file->contents->appendfile(words);
 }
 
 // Reads a plain file and outputs its text.
-// Captures the current directory and its contents, scans each one to
-// see if a content name matches the given search name, checks to make
-// sure it is a readable file, and then outputs the file's word vector.
+// Each argument is resolved as a pathname, checked to make sure it
+// is a readable file, and then the file's word vector is output.
 void inode_state::read_file
-(const inode_ptr& curr_dir, const wordvec& words) const {
+(const inode_ptr& curr_dir, word_span words) const {
    for (size_t k = 1; k != words.size(); ++k) {
-      bool file_found = false;      // Flags true if file found.
-      map<string, inode_ptr> dirents =
-               curr_dir->contents->get_contents();
-      for (auto i = dirents.cbegin(); i != dirents.cend(); ++i) {
-         // Search to see if a file or directory shares the name.
-         if (i->first == words.at(k)) {
-            // See if the matching file is a directory.
-            if (i->second->contents->is_dir() == false) {
-               file_found = true;
-               for (auto j = i->second->contents->readfile().begin();
-                        j != i->second->contents->readfile().end();
-                        ++j) {
-                  cout << *j << " ";
-               }
-               // If the match is a directory, throw an error.
-            } else if (i->second->contents->is_dir() == true) {
-               throw command_error("fn_cat: cannot read directories.");
-            }
-            cout << endl;
-         }
-      }
-      // If there are no matches in the directory's entities, error.
-      if (!file_found) {
+      inode_ptr file = resolve(curr_dir, words.at(k)).target;
+      // If there is no such entity, error.
+      if (file == nullptr) {
          throw command_error("fn_cat: file not found.");
       }
+      // If the match is a directory, throw an error.
+      if (file->contents->is_dir()) {
+         throw command_error("fn_cat: cannot read directories.");
+      }
+      auto guard = file->contents->read_lock();
+      file->contents->get_body().for_each_chunk(
+         [this](const char* bytes, size_t length) {
+            out().write(bytes, length);
+         });
+      out() << endl;
    }
 }
 
 void inode_state::make_directory
-(const inode_ptr& curr_dir, const wordvec& path) const {
-      wordvec path_name = split(path.at(1), "/");
-      map<string, inode_ptr> dirents = curr_dir->
-               contents->get_contents();
-      //mk_dir will point to the dir where the new dir is created
-      inode_ptr mk_dir = curr_dir; bool dir_found = false;
-      for(size_t i = 0; i < path_name.size() - 1; ++i){
-         dir_found = false;
-         for(auto j = dirents.cbegin(); j != dirents.cend(); ++j){
-            if(j->first == path_name.at(i) + "/"){
-               mk_dir = j->second;
-               dir_found = true;
-            }
-         }
-         if(dir_found == false){
-            throw command_error("make_directory: invalid pathname");
-         }
-         dirents = mk_dir->contents->get_contents();
+(const inode_ptr& curr_dir, word_span path) const {
+      resolved_path where = resolve(curr_dir, path.at(1));
+      //Check to see if an entry with that name already exists
+      if(where.target != nullptr){
+         throw command_error
+         ("make_directory: a dir already exists with that name");
       }
-      //Check to see if a dir with that name already exists
-      for(auto i = dirents.cbegin(); i != dirents.cend(); ++i){
-         if(i->first == path_name.at(path_name.size() - 1) + "/"){
-            throw command_error
-            ("make_directory: a dir already exists with that name");
-         }
+      if(not creatable_name(where.name)){
+         throw command_error("make_directory: invalid pathname");
       }
-      inode_ptr new_dir = mk_dir->contents->mkdir
-               (path_name.at(path_name.size() - 1));
-      new_dir->contents->set_dir(new_dir, mk_dir);
-      dirents.insert(pair<string, inode_ptr>
-      (new_dir->get_name(), new_dir));
-      mk_dir->contents->set_contents(dirents);
+      where.parent->contents->mkdir(where.name);
 }
 
 void inode_state::change_directory
-(inode_state& curr_state, const wordvec& args){
-   if(args.size() == 1) cwd = curr_state.get_root();
+(inode_state& curr_state, word_span args){
+   if(args.size() == 1) set_cwd(curr_state.get_root());
    else{
-      wordvec path_name = split(args.at(1), "/");
-      string path = args.at(1); inode_ptr cd;
-      path = path.at(0);
-      if(path == "/") cd = curr_state.get_root();
-      else cd = curr_state.get_cwd();
-      bool dir_found = false;
-      map<string, inode_ptr> dirents = cd->contents->get_contents();
-      for(size_t i = 0; i < path_name.size(); ++i){
-          dir_found = false;
-          for(auto j = dirents.cbegin(); j != dirents.cend(); ++j){
-             if(j->first == path_name.at(i) + "/"){
-                cd = j->second;
-                dir_found = true;
-             }
-          }
-          if(dir_found == false){
-             throw command_error("change_directory: invalid pathname");
-          }
-          dirents = cd->contents->get_contents();
-       }
-      cwd = cd;
+      inode_ptr cd = resolve(curr_state.get_cwd(), args.at(1)).target;
+      if(cd == nullptr or not cd->contents->is_dir()){
+         throw command_error("change_directory: invalid pathname");
+      }
+      set_cwd(cd);
    }
 }
 
 // Removes the specified file or directory. Will easily remove files,
 // but directories must be empty before being removed.
-// WIP: currently decreases directory size, but not remove the name.
 void inode_state::remove(const inode_ptr& curr_dir,
-         const wordvec& args) const {
+         word_span args) const {
    for (size_t k = 1; k != args.size(); ++k) {
-      bool file_found = false;      // Flags true if file found.
-      map<string, inode_ptr> dirents =
-               curr_dir->contents->get_contents();
-      for (auto i = dirents.cbegin(); i != dirents.cend(); ++i) {
-         // Search to see if a file or directory shares the name.
-         if (i->first == args.at(k)) {
-            // See if the matching file is a directory.
-            if (i->second->contents->is_dir() == false) {
-               file_found = true;
-               curr_dir->contents->get_contents().erase(i);
-               // If the match is a directory, throw an error.
-            } else if (i->second->contents->is_dir() == true) {
-               throw command_error("fn_rm: cannot read directories.");
-            }
-         }
-      }
+      resolved_path path = resolve(curr_dir, args.at(k));
       // If there are no matches in the directory's entities, error.
-      if (!file_found) {
+      if (path.target == nullptr) {
          throw command_error("fn_rm: file not found.");
       }
+      if (path.name.empty() or path.name == "." or path.name == "..") {
+         throw command_error("fn_rm: cannot remove "
+                             + string(args.at(k)));
+      }
+      if (path.target->contents->is_dir()
+          and path.target->contents->size() > 2) {
+         throw command_error("fn_rm: directory not empty.");
+      }
+      if (holds_cwd(path.target)) {
+         throw command_error("fn_rm: cannot remove current directory.");
+      }
+      path.parent->contents->remove(path.target->get_name());
+      path.target.reset();
+      TRACE ('i', "live inodes = %", inode::live_count());
+   }
+}
+
+// Removes files and whole directory trees.  Unlinking the top of the
+// subtree drops the only owning reference to it, which frees every
+// inode below.
+void inode_state::remove_recursively(const inode_ptr& curr_dir,
+         word_span args) const {
+   if (args.size() == 1) throw command_error("fn_rmr: no arg");
+   for (size_t k = 1; k != args.size(); ++k) {
+      resolved_path path = resolve(curr_dir, args.at(k));
+      if (path.target == nullptr) {
+         throw command_error("fn_rmr: file not found.");
+      }
+      if (path.name.empty() or path.name == "." or path.name == "..") {
+         throw command_error("fn_rmr: cannot remove "
+                             + string(args.at(k)));
+      }
+      if (holds_cwd(path.target)) {
+         throw command_error("fn_rmr: cannot remove current directory.");
+      }
+      path.parent->contents->remove(path.target->get_name());
+      path.target.reset();
+      TRACE ('i', "live inodes = %", inode::live_count());
+   }
+}
+
+// True if dir is the cwd of any session on the tree, or one of its
+// ancestors.  Such a directory may not be unlinked, since that cwd
+// would be left unreachable.  Only called under the exclusive lock,
+// so no other session's cwd can be changing.
+bool inode_state::holds_cwd(const inode_ptr& dir) const {
+   for (const inode_state* session: tree->sessions) {
+      for (inode_ptr up = session->cwd; up != nullptr;
+           up = up->contents->lookup("..", false)) {
+         if (up == dir) return true;
+         if (up == root) break;
+      }
    }
+   return false;
 }
 
 //        *********************************************
@@ -401,21 +575,50 @@ void inode_state::remove(const inode_ptr& curr_dir,
 // Default constructor for inode.
 // When inode is called with a file_type parameter, one of those
 // respective files (Plain_type or Directory_type) gets constructed.
-inode::inode(file_type type): inode_nr (next_inode_nr++) {
+inode::inode(file_type type): inode_nr (next_inode_nr++),
+                              name (name_table::intern("")) {
+   ++live_inodes;
+   ++created_inodes;
    switch (type) {
       case file_type::PLAIN_TYPE:
-           contents = make_shared<plain_file>();
+           contents = allocate_shared<plain_file>
+                      (pool_allocator<plain_file>());
            break;
       case file_type::DIRECTORY_TYPE:
-           contents = make_shared<directory>();
+           contents = allocate_shared<directory>
+                      (pool_allocator<directory>());
            break;
    }
-   DEBUGF ('i', "inode " << inode_nr << ", type = " << type);
+   TRACE ('i', "inode %, type = %", inode_nr, type);
+}
+
+inode::~inode() {
+   name_table::release(name);
+   --live_inodes;
+}
+
+void inode::set_name(const string& s) {
+   name_ref interned = name_table::intern(s);
+   name_table::release(name);
+   name = interned;
+}
+
+// For a name already interned, as a snapshot's names are.
+void inode::set_name(name_ref interned) {
+   name_table::hold(interned);
+   name_table::release(name);
+   name = interned;
+}
+
+// The printed name:  directories carry a trailing "/", so the root,
+// whose name is empty, prints as "/".
+string inode::get_name() const {
+   return contents->is_dir() ? *name + "/" : *name;
 }
 
 // Move to header later?
 int inode::get_inode_nr() const {
-   DEBUGF ('i', "inode = " << inode_nr);
+   TRACE ('i', "inode = %", inode_nr);
    return inode_nr;
 }
 
@@ -424,34 +627,54 @@ int inode::get_inode_nr() const {
 //       ****************************************************
 
 // Displays size of plain text file.
-// Counts each individual character within a file.
+// Counts each individual character within a file, plus one for each
+// word to account for spaces removed by delimiter.
 size_t plain_file::size() const {
-   size_t size {0};
-   size = data.size();     // Accounts for spaces removed by delimiter.
-   for (auto word = data.begin();
-             word != data.end();
-             word++) {
-       size += word->size();     // Counts the characters per word.
-   }
+   shared_lock<rw_lock> guard(lock);
+   size_t size = data.word_count() + data.char_count();
    // Compensates for a supposed extra space accounted for by
-   // size = data.size() above if there is at least one word in file.
+   // the word count above if there is at least one word in file.
    if (size > 1) size -= 1;
-   DEBUGF ('i', "size = " << size);
+   TRACE ('i', "size = %", size);
    return size;
 }
 
-const wordvec& plain_file::readfile() const {
-   DEBUGF ('i', data);
+wordvec plain_file::readfile() const {
+   shared_lock<rw_lock> guard(lock);
+   return data.to_wordvec();
+}
+
+const file_body& plain_file::get_body() const {
    return data;
 }
 
-void plain_file::writefile (const wordvec& words) {
-   wordvec new_data;
-   for(size_t i = 2; i < words.size(); ++i){
-      new_data.push_back(words.at(i));
-   }
-   data = new_data;
-   DEBUGF ('i', words);
+void plain_file::writefile (word_span words) {
+   unique_lock<rw_lock> guard(lock);
+   if (words.size() > 2) data.assign(words.begin() + 2, words.end());
+                    else data.clear();
+   TRACE ('i', "% words", words.size());
+}
+
+void plain_file::appendfile (word_span words) {
+   unique_lock<rw_lock> guard(lock);
+   if (words.size() > 2) data.append(words.begin() + 2, words.end());
+   TRACE ('i', "% words", words.size());
+}
+
+void plain_file::set_data(const wordvec& d) {
+   unique_lock<rw_lock> guard(lock);
+   data.assign(d.cbegin(), d.cend());
+}
+
+void plain_file::set_text (string_view text) {
+   unique_lock<rw_lock> guard(lock);
+   data.clear();
+   data.append_text(text);
+}
+
+void plain_file::set_words (word_span words) {
+   unique_lock<rw_lock> guard(lock);
+   data.assign(words.begin(), words.end());
 }
 
 void plain_file::remove (const string&) {
@@ -466,15 +689,27 @@ inode_ptr plain_file::mkfile (const string&) {
    throw file_error ("is a plain file");
 }
 
-void plain_file::set_dir(inode_ptr cwd, inode_ptr parent){
+inode_ptr plain_file::find_or_mkfile (const string&) {
+   throw file_error ("is a plain file");
+}
+
+void plain_file::set_dir(inode_ptr, inode_ptr){
+   throw file_error("is a plain file");
+}
+
+inode_ptr plain_file::lookup(string_view, bool) const {
    throw file_error("is a plain file");
 }
 
-map<string, inode_ptr>& plain_file::get_contents(){
+const dirent_table& plain_file::get_dirents() const {
    throw file_error("is a plain file");
 }
 
-void plain_file::set_contents(const map<string, inode_ptr>&){
+uint64_t plain_file::get_generation() const {
+   throw file_error("is a plain file");
+}
+
+void plain_file::adopt (const inode_ptr&) {
    throw file_error("is a plain file");
 }
 
@@ -483,67 +718,179 @@ void plain_file::set_contents(const map<string, inode_ptr>&){
 //        ***************************************************
 
 // Default constructor for directory.
-// Each directory has null pointers to itself (.) and its parent (..)
+// Each directory has empty links to itself (.) and its parent (..)
 // by default upon creation. These are then set with directory::set_dir.
 directory::directory() {
-   dirents.insert(pair<string, inode_ptr>(".", nullptr));
-   dirents.insert(pair<string, inode_ptr>("..", nullptr));
 }
 
-// Sets the pointers for a directory.
-// The first line sets the . pointer to the directory itself, and the
-// second line sets the .. pointer to the directory's parent.
+// Frees the subtree without recursing once per level:  children that
+// are owned only by this directory have their own children moved onto
+// an explicit stack before they are released.
+directory::~directory() {
+   vector<inode_ptr> doomed;
+   for (const dirent& entry: dirents) doomed.push_back(entry.node);
+   dirents.clear();
+   while (not doomed.empty()) {
+      inode_ptr node = move(doomed.back());
+      doomed.pop_back();
+      const base_file_ptr& contents = node->get_contents();
+      if (node.use_count() != 1 or not contents->is_dir()) continue;
+      directory* dir = static_cast<directory*>(contents.get());
+      for (const dirent& entry: dir->dirents) {
+         doomed.push_back(entry.node);
+      }
+      dir->dirents.clear();
+   }
+}
+
+// Sets the back-links for a directory.
+// The . link refers to the directory itself, and the .. link to the
+// directory's parent.  Neither owns its target.
 void directory::set_dir(inode_ptr cwd, inode_ptr parent){
-   map<string, inode_ptr>::iterator i = dirents.begin();
-   i->second = cwd; ++i;
-   i->second = parent;
+   unique_lock<rw_lock> guard(lock);
+   dot = cwd;
+   dotdot = parent;
+}
+
+// Looks up a single entry without copying the map.  Dot and dotdot
+// are answered from the weak back-links, and are nullptr once the
+// directory they refer to has been freed.
+inode_ptr directory::lookup(string_view name, bool is_dir) const {
+   shared_lock<rw_lock> guard(lock);
+   return find_entry(name, is_dir);
+}
+
+// The lookup itself, for callers already holding the lock.
+inode_ptr directory::find_entry(string_view name, bool is_dir) const {
+   if (name == ".") return dot.lock();
+   if (name == "..") return dotdot.lock();
+   name_ref interned = name_table::find(name);
+   if (interned == nullptr) return nullptr;
+   return dirents.find(interned, is_dir);
 }
 
 // Move to header later?
-map<string, inode_ptr>& directory::get_contents(){
+const dirent_table& directory::get_dirents() const {
    return dirents;
 }
 
-// Move to header later?
-void directory::set_contents(const map<string, inode_ptr>& new_map){
-   dirents = new_map;
+uint64_t directory::get_generation() const {
+   return generation.load(memory_order_acquire);
 }
 
 // Counts the entities within a directory, and returns the size.
+// Dot and dotdot are counted even though they are not in the map.
 size_t directory::size() const {
+   shared_lock<rw_lock> guard(lock);
    size_t size {0};
-   size = dirents.size();
-   DEBUGF ('i', "size = " << size);
+   size = dirents.size() + 2;
+   TRACE ('i', "size = %", size);
    return size;
 }
 
-const wordvec& directory::readfile() const {
+wordvec directory::readfile() const {
+   throw file_error ("is a directory");
+}
+
+const file_body& directory::get_body() const {
    throw file_error ("is a directory");
 }
 
-void directory::writefile (const wordvec&) {
+void directory::writefile (word_span) {
    throw file_error ("is a directory");
 }
 
-void directory::set_data(const wordvec& d){
+void directory::appendfile (word_span) {
+   throw file_error ("is a directory");
+}
+
+void directory::set_data(const wordvec&){
+   throw file_error("is a directory");
+}
+
+void directory::set_text (string_view) {
    throw file_error("is a directory");
 }
+
+void directory::set_words (word_span) {
+   throw file_error("is a directory");
+}
+
+// Links an existing inode without the lookups mkdir and mkfile make
+// first:  the table refuses a duplicate name by itself.
+void directory::adopt (const inode_ptr& child) {
+   unique_lock<rw_lock> guard(lock);
+   if (not dirents.insert(child->get_name_ref(),
+                          child->get_contents()->is_dir(), child)) {
+      throw file_error (*child->get_name_ref() + ": file exists");
+   }
+   generation.fetch_add(1, memory_order_release);
+}
+
+// Removes a dirent by its stored name (directories keep their
+// trailing "/").  Emptiness of directories is checked by the caller.
 void directory::remove (const string& filename) {
-   DEBUGF ('i', filename);
+   if (filename == "." or filename == "..") {
+      throw file_error (filename + ": cannot remove");
+   }
+   bool is_dir = not filename.empty() and filename.back() == '/';
+   unique_lock<rw_lock> guard(lock);
+   name_ref name = name_table::find(is_dir
+                 ? filename.substr(0, filename.size() - 1) : filename);
+   if (name == nullptr or not dirents.erase(name, is_dir)) {
+      throw file_error (filename + ": no such file or directory");
+   }
+   generation.fetch_add(1, memory_order_release);
+   TRACE ('i', "%", filename);
 }
 
+// Makes a new directory and links it into this one.  Its dot and
+// dotdot are set before it is linked, so nothing can find it without
+// them.
 inode_ptr directory::mkdir (const string& dirname) {
-   inode_ptr new_dir = make_shared<inode>(file_type::DIRECTORY_TYPE);
-   new_dir->set_name(dirname + "/");
-   DEBUGF ('i', dirname);
+   unique_lock<rw_lock> guard(lock);
+   if (find_entry(dirname, true) != nullptr
+       or find_entry(dirname, false) != nullptr) {
+      throw file_error (dirname + ": file exists");
+   }
+   inode_ptr new_dir = new_inode(file_type::DIRECTORY_TYPE);
+   new_dir->set_name(dirname);
+   auto child = static_cast<directory*>(new_dir->get_contents().get());
+   child->dot = new_dir;
+   child->dotdot = dot;
+   dirents.insert(new_dir->get_name_ref(), true, new_dir);
+   generation.fetch_add(1, memory_order_release);
+   TRACE ('i', "%", dirname);
    return new_dir;
 }
 
 // Makes a new text file pointing to the current directory.
 inode_ptr directory::mkfile (const string& filename) {
-   inode_ptr file = make_shared<inode>(file_type::PLAIN_TYPE);
+   unique_lock<rw_lock> guard(lock);
+   if (find_entry(filename, true) != nullptr
+       or find_entry(filename, false) != nullptr) {
+      throw file_error (filename + ": file exists");
+   }
+   inode_ptr file = new_inode(file_type::PLAIN_TYPE);
+   file->set_name(filename);
+   dirents.insert(file->get_name_ref(), false, file);
+   generation.fetch_add(1, memory_order_release);
+   TRACE ('i', "%", filename);
+   return file;
+}
+
+// Like mkfile, but an existing entry is returned rather than an
+// error, checked under the same lock the new file is linked under.
+inode_ptr directory::find_or_mkfile (const string& filename) {
+   unique_lock<rw_lock> guard(lock);
+   inode_ptr found = find_entry(filename, true);
+   if (found == nullptr) found = find_entry(filename, false);
+   if (found != nullptr) return found;
+   inode_ptr file = new_inode(file_type::PLAIN_TYPE);
    file->set_name(filename);
-   DEBUGF ('i', filename);
+   dirents.insert(file->get_name_ref(), false, file);
+   generation.fetch_add(1, memory_order_release);
+   TRACE ('i', "%", filename);
    return file;
 }
 
@@ -5,13 +5,20 @@
 #ifndef __INODE_H__
 #define __INODE_H__
 
+#include <atomic>
+#include <cstdint>
 #include <exception>
 #include <iostream>
 #include <memory>
-#include <map>
+#include <shared_mutex>
 #include <vector>
 using namespace std;
 
+#include "dentry_cache.h"
+#include "dirents.h"
+#include "file_body.h"
+#include "rw_lock.h"
+#include "stats.h"
 #include "util.h"
 
 // inode_t -
@@ -25,11 +32,105 @@ class directory;
 using inode_ptr = shared_ptr<inode>;
 using base_file_ptr = shared_ptr<base_file>;
 ostream& operator<< (ostream&, file_type);
-void lsr(inode_ptr&);
+struct lsr_options;
+class journal;
+class inode_state;
+void lsr(const inode_ptr&, const lsr_options&, ostream&);
+void print_dirents(const inode_ptr&, ostream&);
+inode_ptr new_inode(file_type);
+
+// resolved_path -
+//    The result of walking a pathname:  the directory holding the
+//    final component, the final inode itself (nullptr if the last
+//    component does not exist), and the name of that component.
+
+struct resolved_path {
+   inode_ptr parent {nullptr};
+   inode_ptr target {nullptr};
+   string name {""};
+};
+
+// lsr_options -
+//    Settings for a recursive listing:  the pathname to start from
+//    (empty for the cwd), how many levels below it to descend,
+//    whether to print only the number of entries in each directory,
+//    and how many threads format the output.
+
+struct lsr_options {
+   string pathname {""};
+   size_t max_depth {SIZE_MAX};
+   bool counts_only {false};
+   size_t threads {1};
+};
+
+// host_options -
+//    Settings for moving a tree between the simulated file system
+//    and the host:  the host directory, the directory in the
+//    simulated tree (empty for the cwd), and how many threads read
+//    or write host files (zero for one per hardware thread).
+
+struct host_options {
+   string host_dir {""};
+   string pathname {""};
+   size_t threads {0};
+};
+
+// shared_tree -
+//    The part of the state that every session on one tree shares:
+//    the root, the lock that orders their commands, and the sessions
+//    themselves, so that rm can respect every session's cwd and load
+//    can move them all onto the new tree.  Directories and files
+//    lock themselves, so most commands share the lock and run
+//    together.  A command that unlinks inodes, replaces the tree or
+//    needs all of it to stand still holds the lock exclusively, and
+//    so does adding or removing a session.
+
+struct shared_tree {
+   inode_ptr root {nullptr};
+   shared_mutex lock;
+   vector<inode_state*> sessions;
+};
+
 // inode_state -
 //    A small convenient class to maintain the state of the simulated
-//    process:  the root (/), the current directory (.), and the
-//    prompt.
+//    process:  the root (/), the current directory (.), the prompt,
+//    the cache of resolved pathnames, and the session's stats.
+//    The tree itself may be shared with other sessions.
+// inode_state ctor -
+//    Without an argument, makes a new tree holding only the root.
+//    Given a shared_tree, joins it as another session whose cwd is
+//    the root.  Either way the session is added to the tree's list,
+//    and the dtor takes it off again.
+// out -
+//    Where commands write their output, cout unless set_output has
+//    given the session a stream of its own.
+// set_cwd -
+//    Changes the current directory.  Its printed path is cached and
+//    rebuilt only on the first pwd after a change, so pwd is O(1)
+//    however deep the cwd is.  No directory above the cwd can be
+//    removed, so the cached path cannot go stale any other way.
+// cwd_pathname -
+//    The cached path of the cwd, as pwd prints it.
+// set_journal -
+//    Attaches the journal that compact folds into a snapshot.
+// import_tree -
+//    Copies a host directory, and everything below it, into a new
+//    directory of the same name under the given directory.  Files
+//    are read and split into words in parallel.  Prints the number
+//    of inodes and bytes imported and the rates.
+// export_tree -
+//    Mirrors a directory of the simulated tree, and everything below
+//    it, into a host directory, which is created if needed.  Each
+//    file is written as its words separated by spaces, ending with a
+//    newline.  Directories are created first, on one thread, and the
+//    files are written in parallel.
+// save_snapshot -
+//    Writes the whole tree to a host file in the format described
+//    in snapshot.h.
+// load_snapshot -
+//    Replaces the whole tree with one read from a snapshot, keeping
+//    every inode number it had when it was saved.  The cwd of every
+//    session on the tree becomes the root.
 
 class inode_state {
    friend class inode;
@@ -37,27 +138,55 @@ class inode_state {
    private:
       inode_state (const inode_state&) = delete; // copy ctor
       inode_state& operator= (const inode_state&) = delete; // op=
+      shared_ptr<shared_tree> tree;
       inode_ptr root {nullptr};
       inode_ptr cwd {nullptr};
       inode_ptr parent {nullptr};
       string prompt_ {"% "};
+      ostream* output {&cout};
+      mutable dentry_cache dentries;
+      mutable shell_stats stats;
+      mutable string cwd_path {""};
+      mutable bool cwd_path_valid {false};
+      journal* journal_ {nullptr};
+      bool holds_cwd(const inode_ptr&) const;
+      string path_of(const inode_ptr&) const;
+      void join_tree();
+      void move_to_root(const inode_ptr& new_root);
    public:
       inode_state();
-      const string& prompt();
+      explicit inode_state(const shared_ptr<shared_tree>& tree);
+      ~inode_state();
+      const string& prompt() const;
       inode_ptr get_root() const {return root;}
       inode_ptr get_cwd() const {return cwd;}
-      void set_cwd(inode_ptr new_cwd) {cwd = new_cwd;}
+      void set_cwd(inode_ptr new_cwd);
       void set_prompt(string new_prompt){prompt_ = new_prompt;}
       inode_ptr get_parent() const {return parent;}
-      void print_directory(const inode_ptr&, const wordvec&) const;
-      void create_file(const inode_ptr&, const wordvec&) const;
-      void read_file(const inode_ptr&, const wordvec&) const;
+      dentry_cache& get_dentries() const {return dentries;}
+      shell_stats& get_stats() const {return stats;}
+      journal* get_journal() const {return journal_;}
+      void set_journal(journal* new_journal) {journal_ = new_journal;}
+      const shared_ptr<shared_tree>& get_tree() const {return tree;}
+      ostream& out() const {return *output;}
+      void set_output(ostream& new_output) {output = &new_output;}
+      const string& cwd_pathname() const;
+      resolved_path resolve(const inode_ptr&, string_view) const;
+      void print_directory(const inode_ptr&, word_span) const;
+      void create_file(const inode_ptr&, word_span) const;
+      void append_file(const inode_ptr&, word_span) const;
+      void read_file(const inode_ptr&, word_span) const;
       void print_path(const inode_ptr&) const;
-      void make_directory(const inode_ptr&, const wordvec&) const;
-      void change_directory(inode_state&, const wordvec&);
-      void list_recursively(inode_state&, const wordvec&);
-      void remove(const inode_ptr&, const wordvec&) const;
-      friend void lsr(inode_ptr&);
+      void make_directory(const inode_ptr&, word_span) const;
+      void change_directory(inode_state&, word_span);
+      void list_recursively(const inode_ptr&, const lsr_options&) const;
+      void remove(const inode_ptr&, word_span) const;
+      void remove_recursively(const inode_ptr&, word_span) const;
+      void import_tree(const inode_ptr&, const host_options&) const;
+      void export_tree(const inode_ptr&, const host_options&) const;
+      void save_snapshot(const string& filename) const;
+      void load_snapshot(const string& filename);
+      friend void lsr(const inode_ptr&, const lsr_options&, ostream&);
 
 
 
@@ -74,28 +203,49 @@ class inode_state {
 //    number of dirents.  For a text file, the number of characters
 //    when printed (the sum of the lengths of each word, plus the
 //    number of words.
-//    
+// live_count -
+//    The number of inodes currently allocated.  Unlinked subtrees
+//    are freed at once, so this drops when rm or rmr succeeds.
+// created_count -
+//    The number of inodes ever allocated, including the root.
+//    The inode number and the counters are atomic, so inodes may be
+//    made and freed on any number of threads at once.
+// set_name -
+//    Gives the inode a name, interned, and releases its old one.
 
 class inode {
    friend class inode_state;
    private:
-      static int next_inode_nr;
+      static atomic<int> next_inode_nr;
+      static atomic<size_t> live_inodes;
+      static atomic<size_t> created_inodes;
       int inode_nr;
       base_file_ptr contents;
-      string name {""};
+      name_ref name;
    public:
       inode (file_type);
+      ~inode();
       int get_inode_nr() const;
-      void set_name(string s) {name = s;}
-      string get_name() const {return name;}
-      friend void lsr(inode_ptr&);
-
+      static size_t live_count() {return live_inodes;}
+      static size_t created_count() {return created_inodes;}
+      void set_name(const string& s);
+      void set_name(name_ref interned);
+      name_ref get_name_ref() const {return name;}
+      string get_name() const;
+      const base_file_ptr& get_contents() const {return contents;}
+      friend void lsr(const inode_ptr&, const lsr_options&, ostream&);
+      friend void print_dirents(const inode_ptr&, ostream&);
 };
 
 // class base_file -
-// Just a base class at which an inode can point.  No data or
-// functions.  Makes the synthesized members useable only from
-// the derived classes.
+// Just a base class at which an inode can point.  Makes the
+// synthesized members useable only from the derived classes.
+// read_lock -
+//    Every directory and file has a reader-writer lock of its own.
+//    The functions below take it as they need it, except that
+//    get_dirents and get_body hand out references into the contents,
+//    so a caller holds read_lock for as long as it uses them.  Locks
+//    are only ever taken from a directory down to its children.
 
 class file_error: public runtime_error {
    public:
@@ -104,6 +254,7 @@ class file_error: public runtime_error {
 
 class base_file {
    protected:
+      mutable rw_lock lock;
       base_file() = default;
       base_file (const base_file&) = delete;
       base_file (base_file&&) = delete;
@@ -111,49 +262,89 @@ class base_file {
       base_file& operator= (base_file&&) = delete;
    public:
       virtual ~base_file() = default;
+      shared_lock<rw_lock> read_lock() const {
+         return shared_lock<rw_lock>(lock);
+      }
       virtual size_t size() const = 0;
-      virtual const wordvec& readfile() const = 0;
-      virtual void writefile (const wordvec& newdata) = 0;
+      virtual wordvec readfile() const = 0;
+      virtual const file_body& get_body() const = 0;
+      virtual void writefile (word_span newdata) = 0;
+      virtual void appendfile (word_span newdata) = 0;
       virtual void remove (const string& filename) = 0;
       virtual inode_ptr mkdir (const string& dirname) = 0;
       virtual inode_ptr mkfile (const string& filename) = 0;
+      virtual inode_ptr find_or_mkfile (const string& filename) = 0;
       virtual void set_dir(inode_ptr, inode_ptr) = 0;
-      virtual map<string, inode_ptr>& get_contents() = 0;
-      virtual void set_contents(const map<string, inode_ptr>&) = 0;
+      virtual inode_ptr lookup (string_view name,
+                                bool is_dir) const = 0;
+      virtual const dirent_table& get_dirents() const = 0;
+      virtual uint64_t get_generation() const = 0;
+      virtual void adopt (const inode_ptr& child) = 0;
       virtual void set_data(const wordvec& d) = 0;
+      virtual void set_text (string_view text) = 0;
+      virtual void set_words (word_span words) = 0;
       virtual bool is_dir() = 0;
 };
 
 // class plain_file -
 // Used to hold data.
 // synthesized default ctor -
-//    Default vector<string> is a an empty vector.
+//    Default file_body is empty.
 // readfile -
-//    Returns a copy of the contents of the wordvec in the file.
+//    Returns a copy of the contents of the file as a wordvec.
+// get_body -
+//    A read-only view of the contents, without copying, used under
+//    read_lock.
 // writefile -
 //    Replaces the contents of a file with new contents.
+// appendfile -
+//    Adds words to the end of the file, in time proportional to the
+//    number of words added.
+// set_text -
+//    Replaces the contents with the words of a text, separated as
+//    file_body::append_text separates them.
+// set_words -
+//    Replaces the contents with the given words, which may hold
+//    blanks or be empty, as a snapshot stores them.
+// size -
+//    O(1):  the body keeps its word and character counts up to date
+//    rather than recomputing them on every call.
 
 class plain_file: public base_file {
    private:
-      wordvec data;
+      file_body data;
    public:
       virtual size_t size() const override;
-      virtual const wordvec& readfile() const override;
-      virtual void writefile (const wordvec& newdata) override;
+      virtual wordvec readfile() const override;
+      virtual const file_body& get_body() const override;
+      virtual void writefile (word_span newdata) override;
+      virtual void appendfile (word_span newdata) override;
       virtual void remove (const string& filename) override;
       virtual inode_ptr mkdir (const string& dirname) override;
       virtual inode_ptr mkfile (const string& filename) override;
+      virtual inode_ptr find_or_mkfile (const string& filename)
+                        override;
       virtual void set_dir(inode_ptr, inode_ptr) override;
-      virtual map<string, inode_ptr>& get_contents() override;
-      virtual void set_contents(const map<string, inode_ptr>&) override;
-      virtual void set_data(const wordvec& d)override {data = d;}
+      virtual inode_ptr lookup (string_view name,
+                                bool is_dir) const override;
+      virtual const dirent_table& get_dirents() const override;
+      virtual uint64_t get_generation() const override;
+      virtual void adopt (const inode_ptr& child) override;
+      virtual void set_data(const wordvec& d)override;
+      virtual void set_text (string_view text) override;
+      virtual void set_words (word_span words) override;
       virtual bool is_dir() override {return false;}
 };
 
 // class directory -
 // Used to map filenames onto inode pointers.
 // default ctor -
-//    Creates a new map with keys "." and "..".
+//    Creates an empty directory.  Dot (.) and dotdot (..) are kept
+//    outside the map as weak back-links, so a directory owns only
+//    its children and an unlinked subtree is freed as a whole.
+// dtor -
+//    Tears the subtree down iteratively, so freeing a very deep tree
+//    does not recurse once per level.
 // remove -
 //    Removes the file or subdirectory from the current inode.
 //    Throws an file_error if this is not a directory, the file
@@ -167,25 +358,60 @@ class plain_file: public base_file {
 // mkfile -
 //    Create a new empty text file with the given name.  Error if
 //    a dirent with that name exists.
+// find_or_mkfile -
+//    Returns the entry with the given name, directory or file, or a
+//    new empty text file if there is none.  The lookup and the
+//    create are one step under the directory's lock, so two sessions
+//    making the same name at once both get the one file.
+// lookup -
+//    Finds the entry with the given name in O(log n), as a
+//    directory if is_dir is set, otherwise as a plain file.
+//    Returns nullptr if there is no such entry.
+// get_dirents -
+//    A read-only view of the children, in lexicographic order, not
+//    including dot and dotdot.  The map is never copied; mkdir,
+//    mkfile and remove modify it in place, so it is only used under
+//    read_lock.
+// adopt -
+//    Links an inode that already exists under its own name, as when
+//    a snapshot is restored.  Error if the name is taken.
+// get_generation -
+//    Counts the changes made to the entries by mkdir, mkfile and
+//    remove, so the dentry cache can tell when a path it remembers
+//    through this directory may resolve differently.
 
 class directory: public base_file {
    private:
-      // Must be a map, not unordered_map, so printing is lexicographic
-      map<string,inode_ptr> dirents;
+      // Must be ordered, not hashed, so printing is lexicographic
+      dirent_table dirents;
+      weak_ptr<inode> dot;
+      weak_ptr<inode> dotdot;
+      atomic<uint64_t> generation {0};
+      inode_ptr find_entry(string_view name, bool is_dir) const;
    public:
       directory();
+      virtual ~directory();
       directory(const directory&);
       directory(directory&&);
       virtual size_t size() const override;
-      virtual const wordvec& readfile() const override;
-      virtual void writefile (const wordvec& newdata) override;
+      virtual wordvec readfile() const override;
+      virtual const file_body& get_body() const override;
+      virtual void writefile (word_span newdata) override;
+      virtual void appendfile (word_span newdata) override;
       virtual void remove (const string& filename) override;
       virtual inode_ptr mkdir (const string& dirname) override;
       virtual inode_ptr mkfile (const string& filename) override;
+      virtual inode_ptr find_or_mkfile (const string& filename)
+                        override;
       virtual void set_dir(inode_ptr, inode_ptr) override;
-      virtual map<string, inode_ptr>& get_contents() override;
-      virtual void set_contents(const map<string, inode_ptr>&) override;
+      virtual inode_ptr lookup (string_view name,
+                                bool is_dir) const override;
+      virtual const dirent_table& get_dirents() const override;
+      virtual uint64_t get_generation() const override;
+      virtual void adopt (const inode_ptr& child) override;
       virtual void set_data(const wordvec& d)override;
+      virtual void set_text (string_view text) override;
+      virtual void set_words (word_span words) override;
       virtual bool is_dir() override {return true;}
 };
 
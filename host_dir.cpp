@@ -0,0 +1,36 @@
+// $Id: host_dir.cpp,v 1.1 2016-03-19 14:02:10-07 - - $
+// Partner: Darius Sakhapour(dsakhapo@ucsc.edu)
+// Partner: Ryan Wong (rystwong@ucsc.edu)
+
+#include <cstring>
+#include <dirent.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+#include "host_dir.h"
+
+bool read_host_dir (const string& path, vector<host_entry>& entries) {
+   entries.clear();
+   DIR* dir = opendir (path.c_str());
+   if (dir == nullptr) return false;
+   while (const struct dirent* entry = readdir (dir)) {
+      if (strcmp (entry->d_name, ".") == 0
+          or strcmp (entry->d_name, "..") == 0) continue;
+      unsigned char type = entry->d_type;
+      if (type == DT_UNKNOWN) {
+         struct stat status;
+         string child = path + "/" + entry->d_name;
+         if (lstat (child.c_str(), &status) == 0) {
+            if (S_ISDIR (status.st_mode)) type = DT_DIR;
+            else if (S_ISREG (status.st_mode)) type = DT_REG;
+         }
+      }
+      entries.push_back ({entry->d_name,
+                          type == DT_DIR ? host_entry::kind::DIRECTORY
+                        : type == DT_REG ? host_entry::kind::REGULAR
+                        : host_entry::kind::OTHER});
+   }
+   closedir (dir);
+   return true;
+}
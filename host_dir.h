@@ -0,0 +1,29 @@
+// $Id: host_dir.h,v 1.1 2016-03-19 14:02:10-07 - - $
+// Partner: Darius Sakhapour(dsakhapo@ucsc.edu)
+// Partner: Ryan Wong (rystwong@ucsc.edu)
+
+#ifndef __HOST_DIR_H__
+#define __HOST_DIR_H__
+
+#include <string>
+#include <vector>
+using namespace std;
+
+// host_entry -
+//    One entry of a directory on the host.  Symbolic links, devices
+//    and the like are reported as other and are never followed.
+// read_host_dir -
+//    Lists a host directory, without . and .., into entries.
+//    Returns false if it cannot be opened.  Kept apart from the
+//    simulated file system because <dirent.h> declares a struct
+//    dirent of its own.
+
+struct host_entry {
+   enum class kind {DIRECTORY, REGULAR, OTHER};
+   string name;
+   kind type;
+};
+
+bool read_host_dir (const string& path, vector<host_entry>& entries);
+
+#endif
@@ -0,0 +1,297 @@
+// $Id: host_tree.cpp,v 1.1 2016-03-19 14:02:10-07 - - $
+// Partner: Darius Sakhapour(dsakhapo@ucsc.edu)
+// Partner: Ryan Wong (rystwong@ucsc.edu)
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+using namespace std;
+
+#include "commands.h"
+#include "debug.h"
+#include "file_sys.h"
+#include "host_dir.h"
+#include "thread_pool.h"
+
+// A name the shell could have created:  not empty, not . or .., and
+// free of the separators the command line and pathnames split on.
+static bool usable_name(const string& name) {
+   return not name.empty() and name != "." and name != ".."
+      and name.find_first_of("/ \t\n") == string::npos;
+}
+
+// The last component of a host pathname, ignoring trailing slashes.
+static string host_basename(const string& path) {
+   size_t end = path.find_last_not_of('/');
+   if (end == string::npos) return "";
+   size_t start = path.find_last_of('/', end);
+   start = start == string::npos ? 0 : start + 1;
+   return path.substr(start, end + 1 - start);
+}
+
+// Reads a whole host file into text, reusing its capacity.
+static bool read_host_file(const string& path, string& text) {
+   int fd = open(path.c_str(), O_RDONLY);
+   if (fd < 0) return false;
+   text.clear();
+   struct stat status;
+   if (fstat(fd, &status) == 0) text.reserve(status.st_size);
+   char block[64 * 1024];
+   for (;;) {
+      ssize_t got = read(fd, block, sizeof block);
+      if (got < 0 and errno == EINTR) continue;
+      if (got <= 0) {
+         close(fd);
+         return got == 0;
+      }
+      text.append(block, got);
+   }
+}
+
+// Prints the summary line shared by import and export.
+static void report_transfer(ostream& out, const string& what,
+                            size_t inodes, size_t bytes, double seconds) {
+   seconds = max(seconds, 1e-9);
+   out << what << ": " << inodes << " inodes, " << bytes
+        << " bytes in " << seconds << " s ("
+        << static_cast<size_t>(inodes / seconds) << " inodes/sec, "
+        << static_cast<size_t>(bytes / seconds) << " bytes/sec)"
+        << endl;
+}
+
+//        *********************************************
+//        ************** Importing a Tree *************
+//        *********************************************
+
+// The host tree is walked on this thread with an explicit stack, and
+// every directory and file inode is created here through mkdir and
+// mkfile, so inode numbers are handed out in the walk's order and an
+// import gives the same tree however many threads read the files.
+// Reading the files is handed to the pool in batches as soon as their
+// inodes exist, so the walk and the reads overlap and each task is
+// worth its overhead.  Each task touches only the bodies of its own
+// files.
+void inode_state::import_tree(const inode_ptr& curr_dir,
+                              const host_options& options) const {
+   using clock = chrono::steady_clock;
+   auto start_time = clock::now();
+   inode_ptr dest = curr_dir;
+   if (not options.pathname.empty()) {
+      dest = resolve(curr_dir, options.pathname).target;
+      if (dest == nullptr or not dest->contents->is_dir()) {
+         throw command_error("import: " + options.pathname
+                             + ": invalid pathname");
+      }
+   }
+   string top_name = host_basename(options.host_dir);
+   if (not usable_name(top_name)) {
+      throw command_error("import: " + options.host_dir
+                          + ": cannot be a directory name");
+   }
+   vector<host_entry> entries;
+   if (not read_host_dir(options.host_dir, entries)) {
+      throw command_error("import: " + options.host_dir + ": "
+                          + strerror(errno));
+   }
+   inode_ptr top_dir = dest->contents->mkdir(top_name);
+
+   constexpr size_t batch_size = 64;
+   using file_batch = vector<pair<string,inode_ptr>>;
+   // The counters the tasks add to are declared before the pool, so
+   // that if an exception unwinds past them the pool, destroyed
+   // first, has finished its tasks before they are gone.
+   atomic<size_t> bytes {0};
+   atomic<size_t> unreadable {0};
+   thread_pool pool(options.threads);
+   size_t inodes = 1;
+   size_t skipped = 0;
+   file_batch batch;
+   auto flush_batch = [&]() {
+      if (batch.empty()) return;
+      pool.submit([&bytes, &unreadable, files = move(batch)]() {
+         static thread_local string text;
+         for (const auto& file: files) {
+            if (not read_host_file(file.first, text)) {
+               ++unreadable;
+               continue;
+            }
+            bytes += text.size();
+            file.second->get_contents()->set_text(text);
+         }
+      });
+      batch.clear();
+      batch.reserve(batch_size);
+   };
+
+   vector<pair<string,inode_ptr>> stack {{options.host_dir, top_dir}};
+   while (not stack.empty()) {
+      auto [host_path, dir] = move(stack.back());
+      stack.pop_back();
+      if (not read_host_dir(host_path, entries)) {
+         ++unreadable;
+         continue;
+      }
+      for (host_entry& entry: entries) {
+         if (entry.type == host_entry::kind::OTHER
+             or not usable_name(entry.name)) {
+            ++skipped;
+            continue;
+         }
+         string child_path = host_path + "/" + entry.name;
+         if (entry.type == host_entry::kind::DIRECTORY) {
+            inode_ptr child = dir->contents->mkdir(entry.name);
+            stack.emplace_back(move(child_path), move(child));
+         }else {
+            batch.emplace_back(move(child_path),
+                               dir->contents->mkfile(entry.name));
+            if (batch.size() == batch_size) flush_batch();
+         }
+         ++inodes;
+      }
+   }
+   flush_batch();
+   pool.wait();
+
+   chrono::duration<double> elapsed = clock::now() - start_time;
+   report_transfer(out(), "import", inodes, bytes, elapsed.count());
+   if (skipped > 0 or unreadable > 0) {
+      out() << "import: skipped " << skipped << " entries, "
+            << unreadable << " unreadable" << endl;
+   }
+   DEBUGF ('i', options.host_dir << " -> " << inodes << " inodes");
+}
+
+//        *********************************************
+//        ************** Exporting a Tree *************
+//        *********************************************
+
+// Writes a file body as its words separated by spaces with a final
+// newline, in one writev:  the chunks already hold each word followed
+// by a space, so only the last space is swapped for the newline.
+static bool write_host_file(const string& path, const file_body& body,
+                            size_t& bytes) {
+   int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+   if (fd < 0) return false;
+   static thread_local vector<iovec> pieces;
+   pieces.clear();
+   body.for_each_chunk([](const char* chunk, size_t length) {
+      pieces.push_back({const_cast<char*>(chunk), length});
+   });
+   static char newline[] {'\n'};
+   if (not pieces.empty()) {
+      --pieces.back().iov_len;
+      pieces.push_back({newline, 1});
+   }
+   bool written = true;
+   for (size_t next = 0; next < pieces.size(); ) {
+      size_t count = min<size_t>(pieces.size() - next, IOV_MAX);
+      ssize_t got = writev(fd, &pieces[next], count);
+      if (got < 0) {
+         if (errno == EINTR) continue;
+         written = false;
+         break;
+      }
+      bytes += got;
+      for (; next < pieces.size() and size_t(got) >= pieces[next].iov_len;
+           ++next) {
+         got -= pieces[next].iov_len;
+      }
+      if (next < pieces.size()) {
+         pieces[next].iov_base = static_cast<char*>(pieces[next].iov_base)
+                               + got;
+         pieces[next].iov_len -= got;
+      }
+   }
+   return close(fd) == 0 and written;
+}
+
+// The tree is walked on this thread, which makes each host directory
+// before any file in it is handed out.  Files go to the pool in
+// batches as they are found, so directory creation and file writes
+// overlap.  The walk only reads the tree, as do the writers.
+void inode_state::export_tree(const inode_ptr& curr_dir,
+                              const host_options& options) const {
+   using clock = chrono::steady_clock;
+   auto start_time = clock::now();
+   inode_ptr source = curr_dir;
+   if (not options.pathname.empty()) {
+      source = resolve(curr_dir, options.pathname).target;
+      if (source == nullptr or not source->contents->is_dir()) {
+         throw command_error("export: " + options.pathname
+                             + ": invalid pathname");
+      }
+   }
+   if (mkdir(options.host_dir.c_str(), 0777) != 0 and errno != EEXIST) {
+      throw command_error("export: " + options.host_dir + ": "
+                          + strerror(errno));
+   }
+   struct stat status;
+   if (stat(options.host_dir.c_str(), &status) != 0
+       or not S_ISDIR(status.st_mode)) {
+      throw command_error("export: " + options.host_dir
+                          + ": not a directory");
+   }
+
+   constexpr size_t batch_size = 256;
+   using file_batch = vector<pair<string,inode_ptr>>;
+   // Declared before the pool for the same reason as in import_tree.
+   atomic<size_t> bytes {0};
+   atomic<size_t> failed {0};
+   thread_pool pool(options.threads);
+   size_t inodes = 1;
+   file_batch batch;
+   auto flush_batch = [&]() {
+      if (batch.empty()) return;
+      pool.submit([&bytes, &failed, files = move(batch)]() {
+         size_t written = 0;
+         for (const auto& file: files) {
+            auto guard = file.second->get_contents()->read_lock();
+            if (not write_host_file(file.first,
+                       file.second->get_contents()->get_body(),
+                       written)) {
+               ++failed;
+            }
+         }
+         bytes += written;
+      });
+      batch.clear();
+      batch.reserve(batch_size);
+   };
+
+   vector<pair<string,inode_ptr>> stack {{options.host_dir, source}};
+   while (not stack.empty()) {
+      auto [host_path, dir] = move(stack.back());
+      stack.pop_back();
+      auto guard = dir->contents->read_lock();
+      for (const dirent& entry: dir->contents->get_dirents()) {
+         string child_path = host_path + "/" + *entry.name;
+         ++inodes;
+         if (not entry.is_dir) {
+            batch.emplace_back(move(child_path), entry.node);
+            if (batch.size() == batch_size) flush_batch();
+         }else if (mkdir(child_path.c_str(), 0777) == 0
+                   or errno == EEXIST) {
+            stack.emplace_back(move(child_path), entry.node);
+         }else {
+            ++failed;
+         }
+      }
+   }
+   flush_batch();
+   pool.wait();
+
+   chrono::duration<double> elapsed = clock::now() - start_time;
+   report_transfer(out(), "export", inodes, bytes, elapsed.count());
+   if (failed > 0) {
+      out() << "export: " << failed << " could not be written" << endl;
+   }
+   DEBUGF ('i', options.host_dir << " <- " << inodes << " inodes");
+}
+
@@ -0,0 +1,254 @@
+// $Id: journal.cpp,v 1.1 2016-03-19 14:02:10-07 - - $
+// Partner: Darius Sakhapour(dsakhapo@ucsc.edu)
+// Partner: Ryan Wong (rystwong@ucsc.edu)
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+#include "batch.h"
+#include "commands.h"
+#include "debug.h"
+#include "file_sys.h"
+#include "journal.h"
+
+constexpr chrono::milliseconds journal::group_interval;
+
+journal::journal (const string& filename_, bool grouped_):
+         filename (filename_), grouped (grouped_) {
+   pending.reserve (group_bytes + 4096);
+   open_for_append();
+   if (grouped) flusher = thread ([this]() { flush_when_due(); });
+}
+
+journal::~journal() {
+   if (flusher.joinable()) {
+      {
+         lock_guard<mutex> guard (lock);
+         closing = true;
+      }
+      wake.notify_one();
+      flusher.join();
+   }
+   try {
+      commit();
+   }catch (command_error& error) {
+      complain() << error.what() << endl;
+   }
+   if (fd >= 0) close (fd);
+}
+
+// The flusher sleeps until there is a group, then until it is due,
+// and commits it unless record already has.  A failed commit is
+// reported and ends the flusher, leaving the group to the next commit
+// made by the shell itself, which reports the error again.
+void journal::flush_when_due() {
+   unique_lock<mutex> guard (lock);
+   while (not closing) {
+      if (pending.empty()) {
+         wake.wait (guard);
+         continue;
+      }
+      auto due = oldest + group_interval;
+      if (chrono::steady_clock::now() < due) {
+         wake.wait_until (guard, due);
+         continue;
+      }
+      try {
+         DEBUGF ('j', "committing an idle group");
+         commit_locked();
+      }catch (command_error& error) {
+         complain() << error.what() << endl;
+         return;
+      }
+   }
+}
+
+// A crash in the middle of a write can leave a last line with no
+// newline.  Replay ignores it, and it is cut off here so that new
+// records do not run on from it.
+void journal::open_for_append() {
+   fd = open (filename.c_str(), O_RDWR | O_APPEND | O_CREAT, 0666);
+   if (fd < 0) {
+      throw command_error ("journal: " + filename + ": "
+                           + strerror (errno));
+   }
+   off_t end = lseek (fd, 0, SEEK_END);
+   char block[4096];
+   while (end > 0) {
+      off_t start = end > off_t (sizeof block) ? end - sizeof block : 0;
+      ssize_t got = pread (fd, block, end - start, start);
+      if (got != end - start) break;
+      const char* newline = static_cast<const char*> (
+                            memrchr (block, '\n', got));
+      if (newline != nullptr) {
+         end = start + (newline - block) + 1;
+         break;
+      }
+      end = start;
+   }
+   if (end != lseek (fd, 0, SEEK_END)) {
+      DEBUGF ('j', filename << ": torn record cut at " << end);
+      if (ftruncate (fd, end) != 0) {
+         throw command_error ("journal: " + filename + ": "
+                              + strerror (errno));
+      }
+   }
+}
+
+void journal::record (const string& line) {
+   lock_guard<mutex> guard (lock);
+   bool starts_group = pending.empty();
+   if (starts_group) oldest = chrono::steady_clock::now();
+   pending += line;
+   pending += '\n';
+   ++records;
+   if (not grouped or pending.size() >= group_bytes
+       or chrono::steady_clock::now() - oldest >= group_interval) {
+      commit_locked();
+   }else if (starts_group) {
+      wake.notify_one();
+   }
+}
+
+void journal::commit() {
+   lock_guard<mutex> guard (lock);
+   commit_locked();
+}
+
+// One write and one fdatasync for the whole group.
+void journal::commit_locked() {
+   if (pending.empty()) return;
+   const char* next = pending.data();
+   size_t left = pending.size();
+   while (left > 0) {
+      ssize_t written = write (fd, next, left);
+      if (written < 0) {
+         if (errno == EINTR) continue;
+         throw command_error ("journal: " + filename + ": "
+                              + strerror (errno));
+      }
+      next += written;
+      left -= written;
+   }
+   if (fdatasync (fd) != 0) {
+      throw command_error ("journal: " + filename + ": "
+                           + strerror (errno));
+   }
+   bytes += pending.size();
+   ++commits;
+   DEBUGF ('j', pending.size() << " bytes committed");
+   pending.clear();
+}
+
+// A prompt command that sets the prompt back as it is.  prompt joins
+// its words with blanks and adds one more, so the text before that
+// blank is written as one quoted word, or, if it holds both kinds of
+// quote, as a word for each blank, each quoted with a kind it does
+// not hold.  Such a word came from an unquoted word, so as a last
+// resort it is written bare.
+static string prompt_command (const string& prompt) {
+   if (prompt.empty()) return "prompt";
+   string_view text = prompt;
+   if (text.back() == ' ') text.remove_suffix (1);
+   auto quoted = [](string_view word) {
+      char quote = word.find ('"') == string_view::npos ? '"'
+                 : word.find ('\'') == string_view::npos ? '\'' : '\0';
+      string result;
+      if (quote != '\0') result += quote;
+      result += word;
+      if (quote != '\0') result += quote;
+      return result;
+   };
+   string command = "prompt";
+   if (text.find ('"') == string_view::npos
+       or text.find ('\'') == string_view::npos) {
+      return command + " " + quoted (text);
+   }
+   for (;;) {
+      size_t blank = text.find (' ');
+      command += " " + quoted (text.substr (0, blank));
+      if (blank == string_view::npos) return command;
+      text.remove_prefix (blank + 1);
+   }
+}
+
+// Holds the lock throughout, so the flusher cannot write to the old
+// file while it is being replaced.
+void journal::compact (const inode_state& state) {
+   lock_guard<mutex> guard (lock);
+   commit_locked();
+   string snapshot = filename + ".snap";
+   state.save_snapshot (snapshot);
+   const string& cwd_path = state.cwd_pathname();
+   string temp_name = filename + ".tmp";
+   {
+      ofstream out (temp_name, ios::trunc);
+      out << "load " << snapshot << "\n"
+          << "cd /" << (cwd_path == "/" ? "" : cwd_path) << "\n"
+          << prompt_command (state.prompt()) << "\n";
+      out.close();
+      if (not out) {
+         throw command_error ("journal: " + temp_name + ": "
+                              + strerror (errno));
+      }
+   }
+   int temp_fd = open (temp_name.c_str(), O_RDONLY);
+   bool synced = temp_fd >= 0 and fsync (temp_fd) == 0;
+   if (temp_fd >= 0) close (temp_fd);
+   if (not synced
+       or rename (temp_name.c_str(), filename.c_str()) != 0) {
+      string reason = strerror (errno);
+      unlink (temp_name.c_str());
+      throw command_error ("journal: " + filename + ": " + reason);
+   }
+   close (fd);
+   open_for_append();
+   DEBUGF ('j', filename << " compacted into " << snapshot);
+}
+
+void journal::report (ostream& out) const {
+   lock_guard<mutex> guard (lock);
+   out << "journal: " << records << " records, " << commits
+       << " commits, " << bytes << " bytes" << endl;
+}
+
+size_t journal::replay (inode_state& state, const string& filename) {
+   int input = open (filename.c_str(), O_RDONLY);
+   if (input < 0) {
+      if (errno == ENOENT) return 0;
+      throw command_error ("journal: " + filename + ": "
+                           + strerror (errno));
+   }
+   script_input script (input);
+   close (input);
+   ofstream discard ("/dev/null");
+   ostream& saved = state.out();
+   state.set_output (discard);
+   size_t lines = 0;
+   size_t failed = 0;
+   string line;
+   vector<string_view> words;
+   while (script.next_line (line)) {
+      ++lines;
+      try {
+         split_words (line, words);
+         if (words.empty()) continue;
+         find_command_fn (words[0]) (state, words);
+      }catch (command_error&) {
+         ++failed;
+      }catch (file_error&) {
+         ++failed;
+      }
+   }
+   state.set_output (saved);
+   DEBUGF ('j', filename << ": replayed " << lines << " lines, "
+           << failed << " failed");
+   return lines;
+}
+
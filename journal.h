@@ -0,0 +1,87 @@
+// $Id: journal.h,v 1.1 2016-03-19 14:02:10-07 - - $
+// Partner: Darius Sakhapour(dsakhapo@ucsc.edu)
+// Partner: Ryan Wong (rystwong@ucsc.edu)
+
+#ifndef __JOURNAL_H__
+#define __JOURNAL_H__
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+using namespace std;
+
+class inode_state;
+
+// journal -
+//    A write-ahead log of every command that changes the state,
+//    kept as the command lines themselves, one per line, in a host
+//    file.  Replaying the file from the start rebuilds the tree, the
+//    cwd and the prompt exactly, inode numbers included, since the
+//    commands are deterministic, provided the snapshot beside it is
+//    unchanged.  Import and load read host files that may change
+//    before a replay, so the shell compacts the journal after each,
+//    keeping what they read rather than their line.
+// ctor -
+//    Opens the file for appending, creating it if needed.  When
+//    grouped is set, records are committed in groups:  a group is
+//    written and synced once it holds group_bytes, or once its
+//    oldest record is group_interval old, or when the journal is
+//    closed.  A thread of the journal's own commits a group that has
+//    waited group_interval, so a record is never left unsynced for
+//    longer than that while the shell is busy or idle.  Otherwise
+//    every record is synced before the command runs.
+// record -
+//    Adds a command line to the journal.  Called before the command
+//    is run, whether or not it then succeeds.
+// commit -
+//    Writes and syncs every pending record.
+// compact -
+//    Folds the journal into a snapshot beside it, named with a
+//    ".snap" suffix, and replaces the journal with the few commands
+//    needed to restore from it:  load, cd and prompt.  The prompt is
+//    written quoted, so one with blanks comes back the same.  Both
+//    files are replaced by rename, so a crash leaves one or the
+//    other.
+// replay -
+//    Runs every complete line of a journal against the state, with
+//    output and error messages discarded.  A final line cut short by
+//    a crash is ignored.  Returns the number of lines run.
+
+class journal {
+   private:
+      string filename;
+      int fd {-1};
+      bool grouped;
+      string pending;
+      chrono::steady_clock::time_point oldest;
+      size_t records {0};
+      size_t commits {0};
+      size_t bytes {0};
+      // Guards everything above against the flusher.
+      mutable mutex lock;
+      condition_variable wake;
+      bool closing {false};
+      thread flusher;
+      void open_for_append();
+      void commit_locked();
+      void flush_when_due();
+   public:
+      static constexpr size_t group_bytes = 64 * 1024;
+      static constexpr chrono::milliseconds group_interval {10};
+      journal (const string& filename, bool grouped);
+      ~journal();
+      journal (const journal&) = delete;
+      journal& operator= (const journal&) = delete;
+      void record (const string& line);
+      void commit();
+      void compact (const inode_state& state);
+      void report (ostream& out) const;
+      static size_t replay (inode_state& state, const string& filename);
+};
+
+#endif
+
@@ -2,31 +2,72 @@
 // Partner: Darius Sakhapour(dsakhapo@ucsc.edu)
 // Partner: Ryan Wong (rystwong@ucsc.edu)
 
+#include <chrono>
 #include <cstdlib>
+#include <fstream>
 #include <iostream>
+#include <memory>
 #include <string>
 #include <utility>
 #include <unistd.h>
 
 using namespace std;
 
+#include "batch.h"
 #include "commands.h"
 #include "debug.h"
 #include "file_sys.h"
+#include "journal.h"
+#include "server.h"
+#include "trace.h"
 #include "util.h"
 
+bool batch_mode = false;
+string snapshot_name = "";
+string journal_name = "";
+string stats_name = "";
+string server_name = "";
+string client_name = "";
+size_t server_threads = 0;
+
 // scan_options
-//    Options analysis:  The only option is -Dflags. 
+//    Options analysis:  -@flags sets debug flags, -b selects batch
+//    mode, -l file starts from a snapshot instead of an empty root,
+//    -j file replays a journal and then adds to it, -s file writes
+//    the session's stats to file as JSON at exit, -S socket serves
+//    sessions on a Unix domain socket with -t threads running them,
+//    and -c socket runs stdin as a session of such a server.
 
 void scan_options (int argc, char** argv) {
    opterr = 0;
    for (;;) {
-      int option = getopt (argc, argv, "@:");
+      int option = getopt (argc, argv, "@:bc:j:l:s:S:t:");
       if (option == EOF) break;
       switch (option) {
          case '@':
             debugflags::setflags (optarg);
             break;
+         case 'b':
+            batch_mode = true;
+            break;
+         case 'c':
+            client_name = optarg;
+            break;
+         case 'j':
+            journal_name = optarg;
+            break;
+         case 'l':
+            snapshot_name = optarg;
+            break;
+         case 's':
+            stats_name = optarg;
+            break;
+         case 'S':
+            server_name = optarg;
+            break;
+         case 't':
+            server_threads = strtoul (optarg, nullptr, 10);
+            break;
          default:
             complain() << "-" << static_cast<char> (option)
                        << ": invalid option" << endl;
@@ -36,6 +77,112 @@ void scan_options (int argc, char** argv) {
    if (optind < argc) {
       complain() << "operands not permitted" << endl;
    }
+   if (not server_name.empty() and not journal_name.empty()) {
+      complain() << "-j: not supported with -S" << endl;
+      journal_name = "";
+   }
+}
+
+// execute_line -
+//    Split the line into words, as views into it kept in a vector
+//    reused from line to line, and lookup the appropriate function.
+//    Complain or call it.  A command that changes the state is
+//    written to the journal, if there is one, before it runs, and
+//    one that reads host files into the tree has the journal
+//    compacted after it, so a replay never reads them again.
+
+void execute_line (inode_state& state, const string& line) {
+   try {
+      static thread_local vector<string_view> words;
+      split_words (line, words);
+      if (words.empty()) return;
+      TRACE ('y', "%, % words", words[0], words.size());
+      const command_info& command = find_command (words[0]);
+      journal* log = command.mutates ? state.get_journal() : nullptr;
+      if (log != nullptr) log->record (line);
+      if (log == nullptr or not command.reads_host) {
+         run_command (state, command, words);
+         return;
+      }
+      // The host files may have changed by the time of a replay, so
+      // the journal is folded into a snapshot of what was read, even
+      // if the command failed part way.
+      try {
+         run_command (state, command, words);
+      }catch (...) {
+         log->compact (state);
+         throw;
+      }
+      log->compact (state);
+   }catch (command_error& error) {
+      // If there is a problem discovered in any function, an
+      // exn is thrown and printed here.
+      complain() << error.what() << endl;
+   }catch (file_error& error) {
+      complain() << error.what() << endl;
+   }
+}
+
+// run_interactive -
+//    Loops reading commands from cin a line at a time.
+
+void run_interactive (inode_state& state, bool need_echo) {
+   for (;;) {
+      // Read a line, break at EOF, and echo print the prompt
+      // if one is needed.
+      cout << state.prompt();
+      string line;
+      getline (cin, line);
+      if (cin.eof()) {
+         if (need_echo) cout << "^D";
+         cout << endl;
+         DEBUGF ('y', "EOF");
+         break;
+      }
+      if (need_echo) cout << line << endl;
+      execute_line (state, line);
+   }
+}
+
+// run_batch -
+//    Runs the whole of stdin as a script.  Input is mapped or read
+//    in large chunks, and output is collected in a batch_buffer, so
+//    the only syscalls are the bulk reads and writes.  The output
+//    is byte for byte what run_interactive prints for the same
+//    input.  Error messages still go straight to cerr.  Returns the
+//    number of lines run, counting an exit that ends the script.
+
+size_t run_batch (inode_state& state, bool need_echo) {
+   script_input script (STDIN_FILENO);
+   size_t lines = 0;
+   string line;
+   for (;;) {
+      cout << state.prompt();
+      if (not script.next_line (line)) {
+         if (need_echo) cout << "^D";
+         cout << endl;
+         DEBUGF ('y', "EOF");
+         break;
+      }
+      ++lines;
+      if (need_echo) cout << line << endl;
+      try {
+         execute_line (state, line);
+      }catch (ysh_exit&) {
+         break;
+      }
+   }
+   return lines;
+}
+
+// write_stats -
+//    Writes the session's stats as JSON, if -s asked for them.
+
+void write_stats (const inode_state& state) {
+   if (stats_name.empty()) return;
+   ofstream out (stats_name, ios::trunc);
+   state.get_stats().write_json (out, state.get_dentries());
+   if (not out) complain() << stats_name << ": cannot write stats" << endl;
 }
 
 // main -
@@ -47,40 +194,67 @@ int main (int argc, char** argv) {
    cerr << boolalpha;
    cout << argv[0] << " build " << __DATE__ << " " << __TIME__ << endl;
    scan_options (argc, argv);
+   if (not client_name.empty()) {
+      run_client (client_name);
+      return exit_status_message();
+   }
    bool need_echo = want_echo();
    inode_state state;
+   unique_ptr<journal> log;
    try {
-      for (;;) {
-         try {
-            // Read a line, break at EOF, and echo print the prompt
-            // if one is needed.
-            cout << state.prompt();
-            string line;
-            getline (cin, line);
-            if (cin.eof()) {
-               if (need_echo) cout << "^D";
-               cout << endl;
-               DEBUGF ('y', "EOF");
-               break;
-            }
-            if (need_echo) cout << line << endl;
-   
-            // Split the line into words and lookup the appropriate
-            // function.  Complain or call it.
-            wordvec words = split (line, " \t");
-            DEBUGF ('y', "words = " << words);
-            command_fn fn = find_command_fn (words.at(0));
-            fn (state, words);
-         }catch (command_error& error) {
-            // If there is a problem discovered in any function, an
-            // exn is thrown and printed here.
-            complain() << error.what() << endl;
-         }
+      if (not snapshot_name.empty()) state.load_snapshot (snapshot_name);
+      if (not journal_name.empty()) {
+         journal::replay (state, journal_name);
+         log = make_unique<journal> (journal_name, batch_mode);
+         state.set_journal (log.get());
+      }
+   }catch (command_error& error) {
+      complain() << error.what() << endl;
+   }
+   if (not server_name.empty()) {
+      try {
+         run_server (state, server_name, server_threads);
+      }catch (command_error& error) {
+         complain() << error.what() << endl;
       }
-   } catch (ysh_exit&) {
-      // This catch intentionally left blank.
+      trace::dump (cerr);
+      return exit_status_message();
+   }
+   if (not batch_mode) {
+      try {
+         run_interactive (state, need_echo);
+      } catch (ysh_exit&) {
+         // This catch intentionally left blank.
+      }
+      DEBUGS ('d', state.get_dentries().report (cerr));
+      if (log != nullptr) DEBUGS ('j', log->report (cerr));
+      write_stats (state);
+      trace::dump (cerr);
+      return exit_status_message();
    }
 
-   return exit_status_message();
+   batch_buffer buffer (STDOUT_FILENO);
+   streambuf* saved = cout.rdbuf (&buffer);
+   auto start = chrono::steady_clock::now();
+   size_t lines = run_batch (state, need_echo);
+   DEBUGS ('d', state.get_dentries().report (cerr));
+   if (log != nullptr) {
+      try {
+         log->commit();
+      }catch (command_error& error) {
+         complain() << error.what() << endl;
+      }
+      DEBUGS ('j', log->report (cerr));
+   }
+   write_stats (state);
+   trace::dump (cerr);
+   int status = exit_status_message();
+   buffer.flush_all();
+   cout.rdbuf (saved);
+   chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+   cerr << execname() << ": batch: " << lines << " lines in "
+        << elapsed.count() << " s ("
+        << static_cast<size_t> (lines / elapsed.count())
+        << " lines/sec)" << endl;
+   return status;
 }
-
@@ -0,0 +1,65 @@
+// $Id: pool.cpp,v 1.1 2016-03-19 14:02:10-07 - - $
+// Partner: Darius Sakhapour(dsakhapo@ucsc.edu)
+// Partner: Ryan Wong (rystwong@ucsc.edu)
+
+#include <iostream>
+
+using namespace std;
+
+#include "pool.h"
+#include "trace.h"
+
+atomic<size_t> pool_stats::slabs {0};
+atomic<size_t> pool_stats::allocated {0};
+atomic<size_t> pool_stats::freed {0};
+
+slab_pool::slab_pool (size_t block_size_): block_size (block_size_) {
+}
+
+// Carves a fresh slab into blocks and threads them onto the free
+// list.  Called with the lock held.
+void slab_pool::refill() {
+   char* slab = static_cast<char*> (::operator new (slab_size));
+   ++pool_stats::slabs;
+   for (size_t offset = slab_size - slab_size % block_size;
+        offset >= block_size; offset -= block_size) {
+      free_block* block = reinterpret_cast<free_block*>
+                          (slab + offset - block_size);
+      block->next = free_list;
+      free_list = block;
+   }
+   TRACE ('m', "slab for % byte blocks", block_size);
+}
+
+void* slab_pool::allocate() {
+   lock_guard<mutex> guard (lock);
+   if (free_list == nullptr) refill();
+   free_block* block = free_list;
+   free_list = block->next;
+   ++pool_stats::allocated;
+   return block;
+}
+
+void slab_pool::deallocate (void* block) {
+   lock_guard<mutex> guard (lock);
+   free_block* freed_block = static_cast<free_block*> (block);
+   freed_block->next = free_list;
+   free_list = freed_block;
+   ++pool_stats::freed;
+}
+
+// The pools are created once and deliberately never destroyed, so
+// objects freed during static destruction still have a home.
+slab_pool* slab_pool::for_size (size_t size) {
+   constexpr size_t classes = max_block / granularity;
+   static slab_pool** pools = [] {
+      slab_pool** table = new slab_pool*[classes];
+      for (size_t i = 0; i < classes; ++i) {
+         table[i] = new slab_pool ((i + 1) * granularity);
+      }
+      return table;
+   }();
+   if (size == 0 or size > max_block) return nullptr;
+   return pools[(size - 1) / granularity];
+}
+
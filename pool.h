@@ -0,0 +1,96 @@
+// $Id: pool.h,v 1.1 2016-03-19 14:02:10-07 - - $
+// Partner: Darius Sakhapour(dsakhapo@ucsc.edu)
+// Partner: Ryan Wong (rystwong@ucsc.edu)
+
+#ifndef __POOL_H__
+#define __POOL_H__
+
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <new>
+using namespace std;
+
+// slab_pool -
+//    A free list of fixed size blocks carved out of large slabs.
+//    Slabs are taken from the heap 64 KiB at a time and are never
+//    given back, so the file system's small objects (inodes, file
+//    bodies, dirent nodes) sit densely together and creating one
+//    costs a free list pop instead of a call to operator new.
+// for_size -
+//    Returns the shared pool for blocks of the given size, or
+//    nullptr if the size is too big to be pooled.
+// pool_stats -
+//    Counters over all pools:  the number of slabs taken from the
+//    heap, and the number of blocks handed out and given back.
+
+class slab_pool {
+   private:
+      struct free_block { free_block* next; };
+      size_t block_size;
+      free_block* free_list {nullptr};
+      mutex lock;
+      void refill();
+   public:
+      static constexpr size_t granularity = 16;
+      static constexpr size_t max_block = 512;
+      static constexpr size_t slab_size = 64 * 1024;
+      explicit slab_pool (size_t block_size);
+      slab_pool (const slab_pool&) = delete;
+      slab_pool& operator= (const slab_pool&) = delete;
+      void* allocate();
+      void deallocate (void* block);
+      static slab_pool* for_size (size_t size);
+};
+
+struct pool_stats {
+   static atomic<size_t> slabs;
+   static atomic<size_t> allocated;
+   static atomic<size_t> freed;
+};
+
+// pool_allocator -
+//    A standard allocator drawing single objects from the slab pool
+//    of their size.  Arrays and oversized objects go to operator new.
+//    Usable with allocate_shared and the standard containers.
+
+template <typename item_t>
+struct pool_allocator {
+   using value_type = item_t;
+   pool_allocator() = default;
+   template <typename other_t>
+   pool_allocator (const pool_allocator<other_t>&) {}
+   item_t* allocate (size_t count) {
+      slab_pool* pool = count == 1 ? slab_pool::for_size (sizeof (item_t))
+                                   : nullptr;
+      if (pool == nullptr or alignof (item_t) > slab_pool::granularity) {
+         return static_cast<item_t*> (
+                ::operator new (count * sizeof (item_t)));
+      }
+      return static_cast<item_t*> (pool->allocate());
+   }
+   void deallocate (item_t* item, size_t count) {
+      slab_pool* pool = count == 1 ? slab_pool::for_size (sizeof (item_t))
+                                   : nullptr;
+      if (pool == nullptr or alignof (item_t) > slab_pool::granularity) {
+         ::operator delete (item);
+         return;
+      }
+      pool->deallocate (item);
+   }
+};
+
+template <typename item_t, typename other_t>
+bool operator== (const pool_allocator<item_t>&,
+                 const pool_allocator<other_t>&) {
+   return true;
+}
+
+template <typename item_t, typename other_t>
+bool operator!= (const pool_allocator<item_t>&,
+                 const pool_allocator<other_t>&) {
+   return false;
+}
+
+#endif
+
@@ -0,0 +1,57 @@
+// $Id: rw_lock.cpp,v 1.1 2016-03-19 14:02:10-07 - - $
+// Partner: Darius Sakhapour(dsakhapo@ucsc.edu)
+// Partner: Ryan Wong (rystwong@ucsc.edu)
+
+#include <thread>
+
+using namespace std;
+
+#include "rw_lock.h"
+
+// Spins this many times before each yield.
+constexpr unsigned spins_per_yield = 64;
+
+static void back_off (unsigned& spins) {
+   if (++spins < spins_per_yield) {
+#if defined (__x86_64__) || defined (__i386__)
+      __builtin_ia32_pause();
+#endif
+   }else {
+      spins = 0;
+      this_thread::yield();
+   }
+}
+
+// A writer that finds the lock taken announces itself, which stops
+// readers from entering, and waits for the readers to leave.  Taking
+// the lock clears the flag, and any other writer still waiting sets
+// it again.
+void rw_lock::wait_to_lock() {
+   unsigned spins = 0;
+   for (;;) {
+      uint32_t current = state.load (memory_order_relaxed);
+      if ((current & ~writer_waiting) == 0) {
+         if (state.compare_exchange_weak (current, writer,
+                                          memory_order_acquire)) return;
+         continue;
+      }
+      if ((current & writer_waiting) == 0) {
+         state.fetch_or (writer_waiting, memory_order_relaxed);
+      }
+      back_off (spins);
+   }
+}
+
+void rw_lock::wait_to_lock_shared() {
+   unsigned spins = 0;
+   for (;;) {
+      uint32_t current = state.load (memory_order_relaxed);
+      if ((current & (writer | writer_waiting)) == 0) {
+         if (state.compare_exchange_weak (current, current + 1,
+                                          memory_order_acquire)) return;
+         continue;
+      }
+      back_off (spins);
+   }
+}
+
@@ -0,0 +1,60 @@
+// $Id: rw_lock.h,v 1.1 2016-03-19 14:02:10-07 - - $
+// Partner: Darius Sakhapour(dsakhapo@ucsc.edu)
+// Partner: Ryan Wong (rystwong@ucsc.edu)
+
+#ifndef __RW_LOCK_H__
+#define __RW_LOCK_H__
+
+#include <atomic>
+#include <cstdint>
+using namespace std;
+
+// rw_lock -
+//    A reader-writer lock in one word, small enough for every inode
+//    to have its own, where a shared_mutex would add 56 bytes to
+//    each.  Any number of readers hold it together, or one writer
+//    alone.  A writer that has to wait sets a flag that keeps new
+//    readers out, so a steady stream of readers cannot starve it.
+//    Waiting spins for a while and then yields, which suits a lock
+//    held for one directory or file operation.  Not recursive:  a
+//    thread holding it must not take it again, even to read.
+//    Usable with unique_lock and shared_lock.
+
+class rw_lock {
+   private:
+      static constexpr uint32_t writer = 1u << 31;
+      static constexpr uint32_t writer_waiting = 1u << 30;
+      // The number of readers is kept in the low bits.
+      atomic<uint32_t> state {0};
+      void wait_to_lock();
+      void wait_to_lock_shared();
+   public:
+      rw_lock() = default;
+      rw_lock (const rw_lock&) = delete;
+      rw_lock& operator= (const rw_lock&) = delete;
+      bool try_lock() {
+         uint32_t current = state.load (memory_order_relaxed);
+         return (current & ~writer_waiting) == 0
+            and state.compare_exchange_strong (current, writer,
+                                               memory_order_acquire);
+      }
+      void lock() { if (not try_lock()) wait_to_lock(); }
+      void unlock() {
+         state.fetch_and (~writer, memory_order_release);
+      }
+      bool try_lock_shared() {
+         uint32_t current = state.load (memory_order_relaxed);
+         return (current & (writer | writer_waiting)) == 0
+            and state.compare_exchange_strong (current, current + 1,
+                                               memory_order_acquire);
+      }
+      void lock_shared() {
+         if (not try_lock_shared()) wait_to_lock_shared();
+      }
+      void unlock_shared() {
+         state.fetch_sub (1, memory_order_release);
+      }
+};
+
+#endif
+
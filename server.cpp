@@ -0,0 +1,399 @@
+// $Id: server.cpp,v 1.1 2016-03-19 14:02:10-07 - - $
+// Partner: Darius Sakhapour(dsakhapo@ucsc.edu)
+// Partner: Ryan Wong (rystwong@ucsc.edu)
+
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <list>
+#include <mutex>
+#include <sstream>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace std;
+
+#include "commands.h"
+#include "debug.h"
+#include "file_sys.h"
+#include "server.h"
+#include "thread_pool.h"
+#include "trace.h"
+
+// No more input is read from a session once this much of it waits
+// to be run, and its lines are not run while this much output waits
+// to be sent, so neither a fast writer nor a slow reader makes the
+// server hold much more than this for one session.  A line this long
+// ends its session.
+constexpr size_t session_buffer_limit = 256 * 1024;
+
+// session -
+//    One connection.  While busy is set, a task on the pool owns the
+//    session and the polling thread leaves it alone.  The task runs
+//    every complete line in input, writing their output to output,
+//    and adds what it wrote to outgoing for the polling thread to
+//    send.  Once ended, the session is closed as soon as outgoing
+//    has been sent.
+struct session {
+   int fd;
+   inode_state state;
+   ostringstream output;
+   string input;
+   string outgoing;
+   size_t sent {0};
+   bool has_line {false};
+   bool busy {false};
+   bool at_eof {false};
+   bool ended {false};
+   session (int fd_, const shared_ptr<shared_tree>& tree):
+            fd (fd_), state (tree) {
+      state.set_output (output);
+      outgoing = state.prompt();
+   }
+   ~session() { close (fd); }
+   session (const session&) = delete;
+   session& operator= (const session&) = delete;
+};
+
+// The write end of the pipe that wakes the polling thread, both when
+// a task finishes and when a signal asks the server to stop.
+static int wake_fd = -1;
+static volatile sig_atomic_t stop_requested = 0;
+
+static void wake_poller() {
+   char byte = 0;
+   ssize_t written = write (wake_fd, &byte, 1);
+   static_cast<void> (written);
+}
+
+static void request_stop (int) {
+   stop_requested = 1;
+   wake_poller();
+}
+
+static bool socket_address (const string& socket_path,
+                            sockaddr_un& address) {
+   memset (&address, 0, sizeof address);
+   address.sun_family = AF_UNIX;
+   if (socket_path.empty()
+       or socket_path.size() >= sizeof address.sun_path) return false;
+   memcpy (address.sun_path, socket_path.data(), socket_path.size());
+   return true;
+}
+
+// A socket left behind by a server that did not stop cleanly is
+// replaced.  Any other file in the way is an error.
+static int listen_on (const string& socket_path) {
+   sockaddr_un address;
+   if (not socket_address (socket_path, address)) {
+      throw command_error ("server: " + socket_path
+                           + ": invalid socket name");
+   }
+   struct stat status;
+   if (lstat (socket_path.c_str(), &status) == 0
+       and S_ISSOCK (status.st_mode)) {
+      unlink (socket_path.c_str());
+   }
+   int fd = socket (AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                    0);
+   if (fd < 0 or bind (fd, reinterpret_cast<sockaddr*> (&address),
+                       sizeof address) != 0
+       or listen (fd, SOMAXCONN) != 0) {
+      string reason = strerror (errno);
+      if (fd >= 0) close (fd);
+      throw command_error ("server: " + socket_path + ": " + reason);
+   }
+   return fd;
+}
+
+// Runs one line for a session.  Returns false once the session has
+// run exit.
+static bool run_line (session& client, string_view line) {
+   static thread_local vector<string_view> words;
+   split_words (line, words);
+   if (words.empty()) return true;
+   TRACE ('y', "session %: %, % words", client.fd, words[0],
+          words.size());
+   try {
+      run_locked (client.state, find_command (words[0]), words);
+   }catch (ysh_exit&) {
+      return false;
+   }catch (command_error& error) {
+      client.output << execname() << ": " << error.what() << endl;
+   }catch (file_error& error) {
+      client.output << execname() << ": " << error.what() << endl;
+   }
+   return true;
+}
+
+// The task a session's lines run in.  Prints what run_batch prints
+// for the same lines, echo included.
+static void run_lines (session& client) {
+   size_t start = 0;
+   for (;;) {
+      size_t newline = client.input.find ('\n', start);
+      if (newline == string::npos) break;
+      string_view line (client.input.data() + start, newline - start);
+      start = newline + 1;
+      client.output << line << '\n';
+      if (not run_line (client, line)) {
+         client.ended = true;
+         break;
+      }
+      client.output << client.state.prompt();
+   }
+   client.input.erase (0, start);
+   client.has_line = false;
+   if (client.at_eof and not client.ended) {
+      client.output << "^D" << '\n';
+      client.ended = true;
+   }
+   client.outgoing += client.output.str();
+   client.output.str ("");
+}
+
+// A session whose peer has gone away is ended, and whatever it had
+// yet to send is dropped.
+static void drop_session (session& client) {
+   client.at_eof = true;
+   client.ended = true;
+   client.outgoing.clear();
+   client.sent = 0;
+}
+
+static void read_input (session& client) {
+   char block[64 * 1024];
+   ssize_t got = read (client.fd, block, sizeof block);
+   if (got > 0) {
+      if (memchr (block, '\n', got) != nullptr) client.has_line = true;
+      client.input.append (block, got);
+   }else if (got == 0) {
+      client.at_eof = true;
+   }else if (errno != EAGAIN and errno != EINTR) {
+      drop_session (client);
+   }
+}
+
+static void send_output (session& client) {
+   ssize_t sent = send (client.fd, client.outgoing.data() + client.sent,
+                        client.outgoing.size() - client.sent,
+                        MSG_NOSIGNAL);
+   if (sent > 0) {
+      client.sent += sent;
+      if (client.sent == client.outgoing.size()) {
+         client.outgoing.clear();
+         client.sent = 0;
+      }
+   }else if (sent < 0 and errno != EAGAIN and errno != EINTR) {
+      drop_session (client);
+   }
+}
+
+void run_server (inode_state& state, const string& socket_path,
+                 size_t threads) {
+   int listen_fd = listen_on (socket_path);
+   int wake[2];
+   if (pipe2 (wake, O_NONBLOCK | O_CLOEXEC) != 0) {
+      close (listen_fd);
+      throw command_error (string ("server: pipe: ") + strerror (errno));
+   }
+   wake_fd = wake[1];
+   stop_requested = 0;
+   struct sigaction action {};
+   action.sa_handler = request_stop;
+   sigemptyset (&action.sa_mask);
+   struct sigaction old_int, old_term;
+   sigaction (SIGINT, &action, &old_int);
+   sigaction (SIGTERM, &action, &old_term);
+
+   list<session> sessions;
+   mutex finished_lock;
+   vector<session*> finished;
+   size_t served = 0;
+   {
+      thread_pool pool (threads);
+      DEBUGF ('y', socket_path << ": serving with " << pool.size()
+              << " threads");
+      vector<pollfd> polled;
+      vector<session*> polled_sessions;
+      while (not stop_requested) {
+         polled.clear();
+         polled_sessions.clear();
+         polled.push_back ({listen_fd, POLLIN, 0});
+         polled.push_back ({wake[0], POLLIN, 0});
+         for (session& client: sessions) {
+            if (client.busy) continue;
+            short events = 0;
+            if (not client.at_eof
+                and client.input.size() < session_buffer_limit) {
+               events |= POLLIN;
+            }
+            if (client.sent < client.outgoing.size()) events |= POLLOUT;
+            if (events == 0) continue;
+            polled.push_back ({client.fd, events, 0});
+            polled_sessions.push_back (&client);
+         }
+         if (poll (polled.data(), polled.size(), -1) < 0) {
+            if (errno == EINTR) continue;
+            complain() << "server: poll: " << strerror (errno) << endl;
+            break;
+         }
+
+         if (polled[1].revents != 0) {
+            char drain[256];
+            while (read (wake[0], drain, sizeof drain) > 0) {}
+            lock_guard<mutex> guard (finished_lock);
+            for (session* client: finished) client->busy = false;
+            finished.clear();
+         }
+         if (polled[0].revents != 0) {
+            for (;;) {
+               int fd = accept4 (listen_fd, nullptr, nullptr,
+                                 SOCK_NONBLOCK | SOCK_CLOEXEC);
+               if (fd < 0) break;
+               sessions.emplace_back (fd, state.get_tree());
+               ++served;
+               DEBUGF ('y', "session " << fd << " connected");
+            }
+         }
+         for (size_t index = 2; index < polled.size(); ++index) {
+            session& client = *polled_sessions[index - 2];
+            short events = polled[index].events;
+            short revents = polled[index].revents;
+            if (revents & POLLOUT) send_output (client);
+            if ((events & POLLIN)
+                and (revents & (POLLIN | POLLHUP | POLLERR))) {
+               read_input (client);
+            }else if (revents & (POLLHUP | POLLERR)) {
+               drop_session (client);
+            }
+         }
+
+         // Start a task for each idle session with lines to run, and
+         // close each one that has ended and sent everything.
+         for (auto next = sessions.begin(); next != sessions.end(); ) {
+            session& client = *next;
+            bool flushed = client.sent == client.outgoing.size();
+            if (client.busy) {
+               ++next;
+               continue;
+            }
+            if (client.ended and flushed) {
+               DEBUGF ('y', "session " << client.fd << " closed");
+               next = sessions.erase (next);
+               continue;
+            }
+            if (not client.ended and not client.has_line
+                and client.input.size() >= session_buffer_limit) {
+               client.outgoing += execname() + ": line too long\n";
+               client.ended = true;
+            }
+            if (not client.ended and (client.has_line or client.at_eof)
+                and client.outgoing.size() < session_buffer_limit) {
+               client.outgoing.erase (0, client.sent);
+               client.sent = 0;
+               client.busy = true;
+               pool.submit ([&client, &finished, &finished_lock]() {
+                  run_lines (client);
+                  {
+                     lock_guard<mutex> guard (finished_lock);
+                     finished.push_back (&client);
+                  }
+                  wake_poller();
+               });
+            }
+            ++next;
+         }
+      }
+      pool.wait();
+   }
+   sessions.clear();
+   sigaction (SIGINT, &old_int, nullptr);
+   sigaction (SIGTERM, &old_term, nullptr);
+   close (wake[0]);
+   close (wake[1]);
+   wake_fd = -1;
+   close (listen_fd);
+   unlink (socket_path.c_str());
+   DEBUGF ('y', socket_path << ": served " << served << " sessions");
+}
+
+// Reads stdin and the socket in one poll loop, rather than sending
+// all of stdin first, so a long script cannot fill both directions
+// of the socket and leave the client and the server each waiting
+// for the other.
+void run_client (const string& socket_path) {
+   sockaddr_un address;
+   if (not socket_address (socket_path, address)) {
+      complain() << socket_path << ": invalid socket name" << endl;
+      return;
+   }
+   int fd = socket (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+   if (fd < 0 or connect (fd, reinterpret_cast<sockaddr*> (&address),
+                          sizeof address) != 0
+       or fcntl (fd, F_SETFL, O_NONBLOCK) != 0) {
+      complain() << socket_path << ": " << strerror (errno) << endl;
+      if (fd >= 0) close (fd);
+      return;
+   }
+   string pending;
+   size_t sent = 0;
+   bool input_open = true;
+   bool sending = true;
+   char block[64 * 1024];
+   for (;;) {
+      bool room = pending.size() - sent < session_buffer_limit;
+      pollfd polled[2] {
+         {input_open and room ? STDIN_FILENO : -1, POLLIN, 0},
+         {fd, static_cast<short> (sent < pending.size()
+                                  ? POLLIN | POLLOUT : POLLIN), 0},
+      };
+      if (poll (polled, 2, -1) < 0) {
+         if (errno == EINTR) continue;
+         complain() << "client: poll: " << strerror (errno) << endl;
+         break;
+      }
+      if (polled[0].revents != 0) {
+         ssize_t got = read (STDIN_FILENO, block, sizeof block);
+         if (got > 0) pending.append (block, got);
+         else if (got == 0 or errno != EINTR) input_open = false;
+      }
+      if (polled[1].revents & POLLOUT) {
+         ssize_t put = send (fd, pending.data() + sent,
+                             pending.size() - sent, MSG_NOSIGNAL);
+         if (put > 0) sent += put;
+         else if (errno != EAGAIN and errno != EINTR) {
+            input_open = false;
+            pending.clear();
+            sent = 0;
+         }
+         if (sent == pending.size()) {
+            pending.clear();
+            sent = 0;
+         }
+      }
+      if (sending and not input_open and sent == pending.size()) {
+         shutdown (fd, SHUT_WR);
+         sending = false;
+      }
+      if (polled[1].revents & (POLLIN | POLLHUP | POLLERR)) {
+         ssize_t got = read (fd, block, sizeof block);
+         if (got > 0) {
+            cout.write (block, got);
+            cout.flush();
+         }else if (got == 0) {
+            break;
+         }else if (errno != EAGAIN and errno != EINTR) {
+            complain() << socket_path << ": " << strerror (errno) << endl;
+            break;
+         }
+      }
+   }
+   close (fd);
+}
+
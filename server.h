@@ -0,0 +1,38 @@
+// $Id: server.h,v 1.1 2016-03-19 14:02:10-07 - - $
+// Partner: Darius Sakhapour(dsakhapo@ucsc.edu)
+// Partner: Ryan Wong (rystwong@ucsc.edu)
+
+#ifndef __SERVER_H__
+#define __SERVER_H__
+
+#include <cstddef>
+#include <string>
+using namespace std;
+
+class inode_state;
+
+// run_server -
+//    Serves sessions over a Unix domain socket at socket_path until
+//    SIGINT or SIGTERM.  Every connection is a session of its own,
+//    with its own cwd, prompt, dentry cache and stats, on the tree
+//    of the given state, which all of them share.  A session sees
+//    exactly what yshell prints for a script piped into it:  the
+//    prompt, then each line echoed followed by its output, and "^D"
+//    at the end of input.  Error messages come inline, and exit ends
+//    only that session.  One thread polls the socket and every idle
+//    session, and the lines a session has sent are run on a
+//    thread_pool of the given size (zero for one per hardware
+//    thread), one task per session at a time, so each session's
+//    lines run in order while different sessions run in parallel.
+//    Throws a command_error if the socket cannot be set up.
+// run_client -
+//    The client driver:  connects to a server at socket_path, sends
+//    it all of stdin, and copies everything it sends back to stdout
+//    until it closes the connection.
+
+void run_server (inode_state& state, const string& socket_path,
+                 size_t threads);
+void run_client (const string& socket_path);
+
+#endif
+
@@ -0,0 +1,359 @@
+// $Id: snapshot.cpp,v 1.1 2016-03-19 14:02:10-07 - - $
+// Partner: Darius Sakhapour(dsakhapo@ucsc.edu)
+// Partner: Ryan Wong (rystwong@ucsc.edu)
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <unordered_map>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+#include "commands.h"
+#include "debug.h"
+#include "file_sys.h"
+#include "snapshot.h"
+
+static uint64_t align8 (uint64_t offset) {
+   return (offset + 7) & ~uint64_t (7);
+}
+
+//        *********************************************
+//        ************** Saving a Snapshot ************
+//        *********************************************
+
+// Writes the tree in four passes over a breadth first list of its
+// inodes:  one to number inodes and names and lay out the dirents,
+// one to write the inode table, one to write the word lengths, and
+// one to write the words.
+// Nothing is held per inode but a pointer and a dirent index.  The
+// snapshot is written beside its final name and renamed over it, so
+// an existing snapshot is never left half written.
+void inode_state::save_snapshot(const string& filename) const {
+   vector<const inode*> order {root.get()};
+   vector<uint32_t> dirents;
+   vector<name_ref> names;
+   unordered_map<name_ref,uint32_t> name_index;
+   auto number_name = [&](name_ref name) {
+      if (name_index.emplace(name, names.size()).second) {
+         names.push_back(name);
+      }
+   };
+   number_name(root->get_name_ref());
+   uint64_t words = 0;
+   uint64_t body_bytes = 0;
+   for (size_t i = 0; i < order.size(); ++i) {
+      const base_file_ptr& contents = order[i]->get_contents();
+      if (not contents->is_dir()) {
+         words += contents->get_body().word_count();
+         body_bytes += contents->get_body().char_count();
+         continue;
+      }
+      for (const dirent& entry: contents->get_dirents()) {
+         if (order.size() >= UINT32_MAX) {
+            throw command_error("save: " + filename
+                                + ": too many inodes");
+         }
+         dirents.push_back(order.size());
+         order.push_back(entry.node.get());
+         number_name(entry.name);
+      }
+   }
+
+   snapshot_header header {};
+   memcpy(header.magic, snapshot_magic, sizeof header.magic);
+   header.strings = names.size();
+   header.inodes = order.size();
+   header.dirents = dirents.size();
+   header.words = words;
+   header.body_bytes = body_bytes;
+   header.next_inode_nr = inode::next_inode_nr;
+   vector<uint64_t> string_offsets {0};
+   for (name_ref name: names) {
+      string_offsets.push_back(string_offsets.back() + name->size());
+   }
+   header.string_bytes = string_offsets.back();
+   uint64_t strings_end = sizeof header
+                        + string_offsets.size() * sizeof (uint64_t)
+                        + header.string_bytes;
+   uint64_t dirents_end = align8(strings_end)
+                        + order.size() * sizeof (snapshot_inode)
+                        + dirents.size() * sizeof (uint32_t);
+   uint64_t lengths_end = align8(dirents_end) + words * sizeof (uint32_t);
+   header.file_bytes = align8(lengths_end) + body_bytes;
+
+   static const char padding[8] {};
+   string temp_name = filename + ".tmp";
+   vector<char> buffer(1 << 20);
+   ofstream out;
+   out.rdbuf()->pubsetbuf(buffer.data(), buffer.size());
+   out.open(temp_name, ios::binary | ios::trunc);
+   if (not out) {
+      throw command_error("save: " + temp_name + ": " + strerror(errno));
+   }
+   out.write(reinterpret_cast<const char*>(&header), sizeof header);
+   out.write(reinterpret_cast<const char*>(string_offsets.data()),
+             string_offsets.size() * sizeof (uint64_t));
+   for (name_ref name: names) out.write(name->data(), name->size());
+   out.write(padding, align8(strings_end) - strings_end);
+   uint64_t next_dirent = 0;
+   uint64_t next_word = 0;
+   uint64_t next_body = 0;
+   for (const inode* node: order) {
+      const base_file_ptr& contents = node->get_contents();
+      snapshot_inode record {node->get_inode_nr(),
+                             name_index[node->get_name_ref()],
+                             contents->is_dir(), 0, 0, 0};
+      if (record.is_dir) {
+         record.count = contents->get_dirents().size();
+         record.first = next_dirent;
+         next_dirent += record.count;
+      }else {
+         const file_body& body = contents->get_body();
+         if (body.word_count() > UINT32_MAX) {
+            throw command_error("save: " + filename + ": file too big");
+         }
+         record.count = body.word_count();
+         record.first = next_body;
+         record.first_word = next_word;
+         next_body += body.char_count();
+         next_word += body.word_count();
+      }
+      out.write(reinterpret_cast<const char*>(&record), sizeof record);
+   }
+   out.write(reinterpret_cast<const char*>(dirents.data()),
+             dirents.size() * sizeof (uint32_t));
+   out.write(padding, align8(dirents_end) - dirents_end);
+   for (const inode* node: order) {
+      const base_file_ptr& contents = node->get_contents();
+      if (contents->is_dir()) continue;
+      contents->get_body().for_each_word([&out](string_view word) {
+         uint32_t length = word.size();
+         out.write(reinterpret_cast<const char*>(&length),
+                   sizeof length);
+      });
+   }
+   out.write(padding, align8(lengths_end) - lengths_end);
+   for (const inode* node: order) {
+      const base_file_ptr& contents = node->get_contents();
+      if (contents->is_dir()) continue;
+      contents->get_body().for_each_word([&out](string_view word) {
+         out.write(word.data(), word.size());
+      });
+   }
+   out.close();
+   if (not out or rename(temp_name.c_str(), filename.c_str()) != 0) {
+      string reason = strerror(errno);
+      unlink(temp_name.c_str());
+      throw command_error("save: " + filename + ": " + reason);
+   }
+   DEBUGF ('i', filename << ": " << header.inodes << " inodes, "
+           << header.file_bytes << " bytes");
+}
+
+//        *********************************************
+//        ************* Loading a Snapshot ************
+//        *********************************************
+
+// A read-only mapping of a whole file, unmapped when it goes out of
+// scope.
+struct mapped_file {
+   const char* base {nullptr};
+   size_t size {0};
+   explicit mapped_file(const string& filename) {
+      int fd = open(filename.c_str(), O_RDONLY);
+      if (fd < 0) {
+         throw command_error("load: " + filename + ": "
+                             + strerror(errno));
+      }
+      struct stat status;
+      if (fstat(fd, &status) == 0 and status.st_size > 0) {
+         size = status.st_size;
+         void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE,
+                             fd, 0);
+         if (mapped != MAP_FAILED) {
+            base = static_cast<const char*>(mapped);
+            madvise(mapped, size, MADV_SEQUENTIAL);
+         }
+      }
+      close(fd);
+      if (base == nullptr) {
+         throw command_error("load: " + filename + ": not a snapshot");
+      }
+   }
+   ~mapped_file() {
+      munmap(const_cast<char*>(base), size);
+   }
+   mapped_file(const mapped_file&) = delete;
+   mapped_file& operator=(const mapped_file&) = delete;
+};
+
+// The names of a snapshot, each counted as used until the load is
+// over, so none is freed between being interned and being given to
+// the inodes that carry it.
+struct held_names: vector<name_ref> {
+   using vector::vector;
+   ~held_names() {
+      for (name_ref name: *this) {
+         if (name != nullptr) name_table::release(name);
+      }
+   }
+   held_names(const held_names&) = delete;
+   held_names& operator=(const held_names&) = delete;
+};
+
+// Replaces the whole tree with the one in a snapshot.  The sections
+// are used in place from the mapping:  names are interned straight
+// from the string bytes, and each directory's children are created
+// and linked in the order they are stored, which is already the
+// order of its dirent table.  Every count and index is checked
+// against the size of the file before it is used, and the new tree
+// is only swapped in once it is complete, so a bad snapshot leaves
+// the current tree as it was.
+void inode_state::load_snapshot(const string& filename) {
+   mapped_file file(filename);
+   auto corrupt = [&filename](const string& why) {
+      return command_error("load: " + filename + ": bad snapshot: "
+                           + why);
+   };
+   snapshot_header header;
+   if (file.size < sizeof header) throw corrupt("too short");
+   memcpy(&header, file.base, sizeof header);
+   if (memcmp(header.magic, snapshot_magic, sizeof header.magic) != 0) {
+      throw corrupt("wrong magic number");
+   }
+   if (header.file_bytes != file.size) throw corrupt("wrong size");
+   if (header.strings > file.size or header.string_bytes > file.size
+       or header.inodes > file.size or header.dirents > file.size
+       or header.words > file.size
+       or header.body_bytes > file.size or header.inodes == 0
+       or header.inodes > UINT32_MAX) {
+      throw corrupt("bad counts");
+   }
+   uint64_t offsets_at = sizeof header;
+   uint64_t strings_at = offsets_at
+                       + (header.strings + 1) * sizeof (uint64_t);
+   uint64_t inodes_at = align8(strings_at + header.string_bytes);
+   uint64_t dirents_at = inodes_at
+                       + header.inodes * sizeof (snapshot_inode);
+   uint64_t lengths_at = align8(dirents_at
+                         + header.dirents * sizeof (uint32_t));
+   uint64_t bodies_at = align8(lengths_at
+                        + header.words * sizeof (uint32_t));
+   if (bodies_at + header.body_bytes != file.size) {
+      throw corrupt("sections do not fit");
+   }
+   const uint64_t* string_offsets
+         = reinterpret_cast<const uint64_t*>(file.base + offsets_at);
+   const char* string_bytes = file.base + strings_at;
+   const snapshot_inode* records
+         = reinterpret_cast<const snapshot_inode*>(file.base + inodes_at);
+   const uint32_t* dirents
+         = reinterpret_cast<const uint32_t*>(file.base + dirents_at);
+   const uint32_t* word_lengths
+         = reinterpret_cast<const uint32_t*>(file.base + lengths_at);
+   const char* bodies = file.base + bodies_at;
+
+   // A name is usable by a child if it could have been made by make
+   // or mkdir.
+   held_names names(header.strings);
+   vector<bool> usable(header.strings);
+   for (uint64_t i = 0; i < header.strings; ++i) {
+      uint64_t begin = string_offsets[i];
+      uint64_t end = string_offsets[i + 1];
+      if (begin > end or end > header.string_bytes) {
+         throw corrupt("bad string table");
+      }
+      names[i] = name_table::intern(string_view(string_bytes + begin,
+                                                end - begin));
+      usable[i] = not names[i]->empty() and *names[i] != "."
+              and *names[i] != ".."
+              and names[i]->find_first_of("/ \t") == string::npos;
+   }
+
+   int next_nr = header.next_inode_nr;
+   vector<string_view> words;
+   auto make_node = [&](const snapshot_inode& record) {
+      inode_ptr node = new_inode(record.is_dir
+                     ? file_type::DIRECTORY_TYPE : file_type::PLAIN_TYPE);
+      if (record.name >= header.strings or record.inode_nr <= 0) {
+         throw corrupt("bad inode");
+      }
+      node->inode_nr = record.inode_nr;
+      node->set_name(names[record.name]);
+      if (record.inode_nr >= next_nr) next_nr = record.inode_nr + 1;
+      if (not record.is_dir) {
+         if (record.first_word > header.words
+             or record.count > header.words - record.first_word) {
+            throw corrupt("bad file body");
+         }
+         words.clear();
+         uint64_t next = record.first;
+         for (uint64_t k = 0; k < record.count; ++k) {
+            uint32_t length = word_lengths[record.first_word + k];
+            if (next > header.body_bytes
+                or length > header.body_bytes - next) {
+               throw corrupt("bad file body");
+            }
+            words.emplace_back(bodies + next, length);
+            next += length;
+         }
+         node->contents->set_words(words);
+      }
+      return node;
+   };
+
+   if (not records[0].is_dir) throw corrupt("root is not a directory");
+   vector<inode_ptr> dirs(header.inodes);
+   vector<bool> seen(header.inodes);
+   dirs[0] = make_node(records[0]);
+   dirs[0]->set_name("");
+   inode_ptr new_root = dirs[0];
+   new_root->contents->set_dir(new_root, new_root);
+   uint64_t created = 1;
+   try {
+      for (uint64_t i = 0; i < header.inodes; ++i) {
+         const snapshot_inode& record = records[i];
+         if (not record.is_dir) continue;
+         inode_ptr dir = move(dirs[i]);
+         if (dir == nullptr) throw corrupt("unreachable directory");
+         if (record.first > header.dirents
+             or record.count > header.dirents - record.first) {
+            throw corrupt("bad directory");
+         }
+         for (uint64_t k = 0; k < record.count; ++k) {
+            uint32_t index = dirents[record.first + k];
+            if (index <= i or index >= header.inodes or seen[index]
+                or records[index].name >= header.strings
+                or not usable[records[index].name]) {
+               throw corrupt("bad dirent");
+            }
+            seen[index] = true;
+            inode_ptr child = make_node(records[index]);
+            dir->contents->adopt(child);
+            if (records[index].is_dir) {
+               child->contents->set_dir(child, dir);
+               dirs[index] = move(child);
+            }
+            ++created;
+         }
+      }
+   }catch (file_error& error) {
+      throw corrupt(error.what());
+   }
+   if (created != header.inodes) throw corrupt("unreachable inodes");
+
+   tree->root = new_root;
+   for (inode_state* session: tree->sessions) {
+      session->move_to_root(new_root);
+   }
+   inode::next_inode_nr = next_nr;
+   DEBUGF ('i', filename << ": " << created << " inodes");
+}
+
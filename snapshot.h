@@ -0,0 +1,65 @@
+// $Id: snapshot.h,v 1.1 2016-03-19 14:02:10-07 - - $
+// Partner: Darius Sakhapour(dsakhapo@ucsc.edu)
+// Partner: Ryan Wong (rystwong@ucsc.edu)
+
+#ifndef __SNAPSHOT_H__
+#define __SNAPSHOT_H__
+
+#include <cstdint>
+using namespace std;
+
+// snapshot format -
+//    A snapshot holds a whole inode tree in one file, laid out so
+//    that it can be mapped into memory and read in place.  Integers
+//    are in the byte order of the machine that wrote them, and each
+//    section starts on an 8 byte boundary.  In order:
+//
+//    snapshot_header
+//    uint64_t string_offsets[strings + 1]
+//       Where each name starts in the string bytes, plus the end.
+//    char string_bytes[string_bytes]
+//       Every distinct file name, once, without separators.
+//    snapshot_inode inodes[inodes]
+//       In breadth first order, so the root is inode 0 and every
+//       inode comes after its parent.
+//    uint32_t dirents[dirents]
+//       The children of each directory, as indexes into inodes, in
+//       the order ls lists them.  A directory's children are the
+//       slice [first, first + count).
+//    uint32_t word_lengths[words]
+//       The length of every word of every plain file, in the order
+//       of the files in inodes.  A file's words are the slice
+//       [first_word, first_word + count).
+//    char bodies[body_bytes]
+//       The bytes of every word, with nothing between them, so a
+//       word may hold blanks or be empty and still come back as it
+//       was.  A file's bytes start at first.
+//
+//    The whole-file size is recorded in the header so that a
+//    truncated snapshot is refused before anything is built.
+
+struct snapshot_header {
+   char magic[8];
+   uint64_t file_bytes;
+   uint64_t strings;
+   uint64_t string_bytes;
+   uint64_t inodes;
+   uint64_t dirents;
+   uint64_t words;
+   uint64_t body_bytes;
+   int64_t next_inode_nr;
+};
+
+struct snapshot_inode {
+   int32_t inode_nr;
+   uint32_t name;
+   uint32_t is_dir;
+   uint32_t count;
+   uint64_t first;
+   uint64_t first_word;
+};
+
+constexpr char snapshot_magic[8] {'Y','S','H','S','N','A','P','2'};
+
+#endif
+
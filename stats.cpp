@@ -0,0 +1,181 @@
+// $Id: stats.cpp,v 1.1 2016-03-19 14:02:10-07 - - $
+// Partner: Darius Sakhapour(dsakhapo@ucsc.edu)
+// Partner: Ryan Wong (rystwong@ucsc.edu)
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+
+using namespace std;
+
+#include "dentry_cache.h"
+#include "file_sys.h"
+#include "pool.h"
+#include "stats.h"
+#include "trace.h"
+
+//        *********************************************
+//        ************* Latency Histograms ************
+//        *********************************************
+
+// Durations below four nanoseconds have a bucket each.  Above that,
+// the top bit picks a group of four buckets and the two bits below
+// it pick the bucket within the group.
+size_t latency_histogram::bucket_of (uint64_t ns) {
+   if (ns < sub_buckets) return ns;
+   size_t top = 63 - __builtin_clzll (ns);
+   size_t within = (ns >> (top - 2)) & (sub_buckets - 1);
+   return (top - 1) * sub_buckets + within;
+}
+
+uint64_t latency_histogram::bucket_largest (size_t bucket) {
+   if (bucket < sub_buckets) return bucket;
+   size_t top = bucket / sub_buckets + 1;
+   uint64_t within = bucket % sub_buckets;
+   uint64_t smallest = (sub_buckets + within) << (top - 2);
+   return smallest + (uint64_t (1) << (top - 2)) - 1;
+}
+
+void latency_histogram::add (chrono::nanoseconds elapsed) {
+   uint64_t ns = elapsed.count() < 0 ? 0 : elapsed.count();
+   ++counts[bucket_of (ns)];
+   ++samples;
+   total_ns += ns;
+   if (ns < min_ns) min_ns = ns;
+   if (ns > max_ns) max_ns = ns;
+}
+
+double latency_histogram::mean() const {
+   return samples == 0 ? 0 : static_cast<double> (total_ns) / samples;
+}
+
+uint64_t latency_histogram::percentile (double fraction) const {
+   if (samples == 0) return 0;
+   uint64_t rank = ceil (fraction * samples);
+   uint64_t wanted = rank == 0 ? 0 : std::min (rank, samples) - 1;
+   uint64_t seen = 0;
+   for (size_t bucket = 0; bucket < buckets; ++bucket) {
+      seen += counts[bucket];
+      if (seen > wanted) return std::min (bucket_largest (bucket), max_ns);
+   }
+   return max_ns;
+}
+
+//        *********************************************
+//        *************** Session Stats ***************
+//        *********************************************
+
+void shell_stats::record_command (string_view name,
+                                  chrono::nanoseconds elapsed,
+                                  bool failed) {
+   command_stats& command = commands[string (name)];
+   command.latency.add (elapsed);
+   if (failed) ++command.failures;
+   TRACE ('s', "%: % ns, failed = %", name, elapsed.count(), failed);
+}
+
+void shell_stats::record_walk (size_t depth) {
+   ++depths[std::min (depth, max_depth)];
+   ++walks;
+   total_depth += depth;
+   if (depth > deepest) deepest = depth;
+}
+
+// The commands in alphabetical order, for printing.
+vector<const shell_stats::command_map::value_type*>
+shell_stats::sorted_commands() const {
+   vector<const command_map::value_type*> sorted;
+   for (const auto& command: commands) sorted.push_back (&command);
+   sort (sorted.begin(), sorted.end(), [](auto left, auto right) {
+      return left->first < right->first;
+   });
+   return sorted;
+}
+
+// The caller's stream gets back the flags and precision it came with.
+void shell_stats::report (ostream& out,
+                          const dentry_cache& dentries) const {
+   ios_base::fmtflags flags = out.flags();
+   streamsize precision = out.precision();
+   out << left << setw (8) << "command" << right << setw (9) << "calls"
+       << setw (8) << "failed" << setw (11) << "mean ns"
+       << setw (10) << "p50 ns" << setw (10) << "p90 ns"
+       << setw (10) << "p99 ns" << setw (11) << "max ns" << endl;
+   for (const auto* command: sorted_commands()) {
+      const latency_histogram& latency = command->second.latency;
+      out << left << setw (8) << command->first << right
+          << setw (9) << latency.count()
+          << setw (8) << command->second.failures
+          << setw (11) << static_cast<uint64_t> (latency.mean())
+          << setw (10) << latency.percentile (0.50)
+          << setw (10) << latency.percentile (0.90)
+          << setw (10) << latency.percentile (0.99)
+          << setw (11) << latency.max() << endl;
+   }
+   out << "inodes: " << inode::live_count() << " live, "
+       << inode::created_count() << " created" << endl;
+   out << "pool: " << pool_stats::slabs << " slabs, "
+       << pool_stats::allocated << " allocated, "
+       << pool_stats::freed << " freed" << endl;
+   out << "lookups: " << walks << " walks, mean depth " << fixed
+       << setprecision (1)
+       << (walks == 0 ? 0 : static_cast<double> (total_depth) / walks)
+       << ", max depth " << deepest << endl;
+   if (walks > 0) {
+      out << "lookup depths:";
+      for (size_t depth = 0; depth <= max_depth; ++depth) {
+         if (depths[depth] == 0) continue;
+         out << " " << depth << (depth == max_depth ? "+" : "")
+             << ":" << depths[depth];
+      }
+      out << endl;
+   }
+   out.flags (flags);
+   out.precision (precision);
+   dentries.report (out);
+}
+
+void shell_stats::write_json (ostream& out,
+                              const dentry_cache& dentries) const {
+   out << "{\"commands\": {";
+   const char* separator = "";
+   for (const auto* command: sorted_commands()) {
+      const latency_histogram& latency = command->second.latency;
+      out << separator << "\"" << command->first << "\": {"
+          << "\"calls\": " << latency.count()
+          << ", \"failures\": " << command->second.failures
+          << ", \"total_ns\": " << latency.total()
+          << ", \"min_ns\": " << latency.min()
+          << ", \"p50_ns\": " << latency.percentile (0.50)
+          << ", \"p90_ns\": " << latency.percentile (0.90)
+          << ", \"p99_ns\": " << latency.percentile (0.99)
+          << ", \"max_ns\": " << latency.max()
+          << ", \"histogram\": [";
+      const char* bucket_separator = "";
+      latency.for_each_bucket ([&](uint64_t largest, uint64_t count) {
+         out << bucket_separator << "[" << largest << ", " << count << "]";
+         bucket_separator = ", ";
+      });
+      out << "]}";
+      separator = ", ";
+   }
+   out << "}, \"inodes\": {\"live\": " << inode::live_count()
+       << ", \"created\": " << inode::created_count()
+       << "}, \"pool\": {\"slabs\": " << pool_stats::slabs
+       << ", \"allocated\": " << pool_stats::allocated
+       << ", \"freed\": " << pool_stats::freed
+       << "}, \"lookups\": {\"walks\": " << walks
+       << ", \"total_depth\": " << total_depth
+       << ", \"max_depth\": " << deepest << ", \"depths\": [";
+   separator = "";
+   for (size_t depth = 0; depth <= max_depth; ++depth) {
+      if (depths[depth] == 0) continue;
+      out << separator << "[" << depth << ", " << depths[depth] << "]";
+      separator = ", ";
+   }
+   out << "]}, \"dentry_cache\": {\"entries\": " << dentries.size()
+       << ", \"bytes\": " << dentries.memory()
+       << ", \"hit_rate\": " << dentries.hit_rate() << "}}" << endl;
+}
+
@@ -0,0 +1,101 @@
+// $Id: stats.h,v 1.1 2016-03-19 14:02:10-07 - - $
+// Partner: Darius Sakhapour(dsakhapo@ucsc.edu)
+// Partner: Ryan Wong (rystwong@ucsc.edu)
+
+#ifndef __STATS_H__
+#define __STATS_H__
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+class dentry_cache;
+
+// latency_histogram -
+//    Counts durations in buckets that grow geometrically, four to
+//    each power of two nanoseconds, so it takes the same space
+//    however many samples it holds, and a percentile read from it is
+//    at most a quarter above the true value.
+// add -
+//    Records one duration.
+// percentile -
+//    The largest duration in the bucket holding the given fraction
+//    of the samples, but no more than the largest sample.
+// for_each_bucket -
+//    Calls fn(largest, count) for each bucket that is not empty, in
+//    increasing order.
+
+class latency_histogram {
+   public:
+      static constexpr size_t sub_buckets = 4;
+      static constexpr size_t buckets = 64 * sub_buckets;
+   private:
+      array<uint64_t,buckets> counts {};
+      uint64_t samples {0};
+      uint64_t total_ns {0};
+      uint64_t min_ns {UINT64_MAX};
+      uint64_t max_ns {0};
+      static size_t bucket_of (uint64_t ns);
+      static uint64_t bucket_largest (size_t bucket);
+   public:
+      void add (chrono::nanoseconds elapsed);
+      uint64_t count() const {return samples;}
+      uint64_t total() const {return total_ns;}
+      uint64_t min() const {return samples == 0 ? 0 : min_ns;}
+      uint64_t max() const {return max_ns;}
+      double mean() const;
+      uint64_t percentile (double fraction) const;
+      template <typename fn_t>
+      void for_each_bucket (fn_t fn) const {
+         for (size_t bucket = 0; bucket < buckets; ++bucket) {
+            if (counts[bucket] > 0) fn (bucket_largest (bucket),
+                                        counts[bucket]);
+         }
+      }
+};
+
+// shell_stats -
+//    Counters for one session:  the calls, failures and latency of
+//    each command as run from the command line, and the depth of
+//    every pathname walk that missed the dentry cache.  Inode and
+//    allocation counts are global and are read when printed.
+// record_command -
+//    Adds one call of a command, which failed if it threw an error.
+// record_walk -
+//    Adds one pathname walk that looked into depth directories.
+// report -
+//    Prints everything as a table.
+// write_json -
+//    Prints everything as one JSON object, on one line.
+
+class shell_stats {
+   public:
+      static constexpr size_t max_depth = 64;
+   private:
+      struct command_stats {
+         uint64_t failures {0};
+         latency_histogram latency;
+      };
+      using command_map = unordered_map<string,command_stats>;
+      command_map commands;
+      array<uint64_t,max_depth + 1> depths {};
+      uint64_t walks {0};
+      uint64_t total_depth {0};
+      size_t deepest {0};
+      vector<const command_map::value_type*> sorted_commands() const;
+   public:
+      void record_command (string_view name,
+                           chrono::nanoseconds elapsed, bool failed);
+      void record_walk (size_t depth);
+      void report (ostream& out, const dentry_cache& dentries) const;
+      void write_json (ostream& out, const dentry_cache& dentries) const;
+};
+
+#endif
+
@@ -0,0 +1,127 @@
+// $Id: thread_pool.cpp,v 1.1 2016-03-19 14:02:10-07 - - $
+// Partner: Darius Sakhapour(dsakhapo@ucsc.edu)
+// Partner: Ryan Wong (rystwong@ucsc.edu)
+
+#include <algorithm>
+#include <iostream>
+#include <system_error>
+
+using namespace std;
+
+#include "commands.h"
+#include "debug.h"
+#include "thread_pool.h"
+#include "trace.h"
+
+// Index of the worker running on this thread, or SIZE_MAX.
+static thread_local size_t worker_index = SIZE_MAX;
+static thread_local const thread_pool* worker_pool = nullptr;
+
+// Workers already started when one fails to start are stopped again
+// before the error is thrown, since the dtor will not run.
+thread_pool::thread_pool (size_t threads) {
+   if (threads == 0) threads = thread::hardware_concurrency();
+   if (threads == 0) threads = 1;
+   threads = min (threads, max_threads);
+   for (size_t i = 0; i < threads; ++i) {
+      queues.push_back (make_unique<task_queue>());
+   }
+   try {
+      for (size_t i = 0; i < threads; ++i) {
+         workers.emplace_back (&thread_pool::run, this, i);
+      }
+   }catch (system_error& error) {
+      stop();
+      throw command_error ("thread_pool: cannot start "
+                           + to_string (threads) + " workers: "
+                           + error.what());
+   }
+   DEBUGF ('p', "started " << threads << " workers");
+}
+
+thread_pool::~thread_pool() {
+   stop();
+}
+
+void thread_pool::stop() {
+   {
+      lock_guard<mutex> guard (state_lock);
+      stopping = true;
+   }
+   work_ready.notify_all();
+   for (auto& worker: workers) worker.join();
+}
+
+void thread_pool::submit (task job) {
+   size_t target = worker_pool == this ? worker_index
+                 : next_queue++ % queues.size();
+   {
+      lock_guard<mutex> guard (state_lock);
+      ++pending;
+   }
+   {
+      lock_guard<mutex> guard (queues[target]->lock);
+      queues[target]->tasks.push_back (move (job));
+   }
+   {
+      lock_guard<mutex> guard (state_lock);
+      ++queued;
+   }
+   work_ready.notify_one();
+}
+
+void thread_pool::wait() {
+   unique_lock<mutex> guard (state_lock);
+   all_done.wait (guard, [this] { return pending == 0; });
+}
+
+// Takes the newest task from the worker's own deque, or else steals
+// the oldest task from the first other deque that has one.
+bool thread_pool::take (size_t self, task& job) {
+   {
+      task_queue& own = *queues[self];
+      lock_guard<mutex> guard (own.lock);
+      if (not own.tasks.empty()) {
+         job = move (own.tasks.back());
+         own.tasks.pop_back();
+         return true;
+      }
+   }
+   for (size_t offset = 1; offset < queues.size(); ++offset) {
+      task_queue& victim = *queues[(self + offset) % queues.size()];
+      lock_guard<mutex> guard (victim.lock);
+      if (not victim.tasks.empty()) {
+         job = move (victim.tasks.front());
+         victim.tasks.pop_front();
+         TRACE ('p', "worker % stole a task", self);
+         return true;
+      }
+   }
+   return false;
+}
+
+void thread_pool::run (size_t self) {
+   worker_index = self;
+   worker_pool = this;
+   for (;;) {
+      task job;
+      if (take (self, job)) {
+         {
+            lock_guard<mutex> guard (state_lock);
+            --queued;
+         }
+         job();
+         lock_guard<mutex> guard (state_lock);
+         if (--pending == 0) all_done.notify_all();
+         continue;
+      }
+      unique_lock<mutex> guard (state_lock);
+      if (stopping) break;
+      // Sleep until a task is queued somewhere.  A task is counted in
+      // queued only once it is on a deque, so a wakeup is not lost.
+      work_ready.wait (guard, [this] {
+         return stopping or queued > 0;
+      });
+   }
+}
+
@@ -0,0 +1,66 @@
+// $Id: thread_pool.h,v 1.1 2016-03-19 14:02:10-07 - - $
+// Partner: Darius Sakhapour(dsakhapo@ucsc.edu)
+// Partner: Ryan Wong (rystwong@ucsc.edu)
+
+#ifndef __THREAD_POOL_H__
+#define __THREAD_POOL_H__
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+using namespace std;
+
+// thread_pool -
+//    A fixed set of worker threads with one task deque each.  A
+//    worker takes its own newest task first and, when its deque is
+//    empty, steals the oldest task from another worker, so uneven
+//    tasks balance themselves out.
+// thread_pool ctor -
+//    Starts the given number of workers.  Zero means one per
+//    hardware thread, and more than max_threads means max_threads.
+//    Throws a command_error, with no workers left running, if the
+//    system will not start them all.
+// submit -
+//    Queues a task.  Tasks submitted from a worker go on that
+//    worker's own deque; others are dealt round robin.
+// wait -
+//    Blocks until every submitted task has finished.  Not to be
+//    called from a worker.
+
+class thread_pool {
+   private:
+      using task = function<void()>;
+      struct task_queue {
+         mutex lock;
+         deque<task> tasks;
+      };
+      vector<unique_ptr<task_queue>> queues;
+      vector<thread> workers;
+      atomic<size_t> next_queue {0};
+      size_t pending {0};   // Submitted and not yet finished.
+      long queued {0};      // Submitted and not yet taken.
+      bool stopping {false};
+      mutex state_lock;
+      condition_variable work_ready;
+      condition_variable all_done;
+      bool take (size_t self, task& job);
+      void run (size_t self);
+      void stop();
+   public:
+      static constexpr size_t max_threads = 256;
+      explicit thread_pool (size_t threads = 0);
+      ~thread_pool();
+      thread_pool (const thread_pool&) = delete;
+      thread_pool& operator= (const thread_pool&) = delete;
+      size_t size() const { return workers.size(); }
+      void submit (task job);
+      void wait();
+};
+
+#endif
+
@@ -0,0 +1,145 @@
+// $Id: trace.cpp,v 1.1 2016-03-19 14:02:10-07 - - $
+// Partner: Darius Sakhapour(dsakhapo@ucsc.edu)
+// Partner: Ryan Wong (rystwong@ucsc.edu)
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+using namespace std;
+
+#include "trace.h"
+#include "util.h"
+
+// A thread's ring.  Only its own thread writes it, so the count of
+// events is atomic only so that dump reads a whole value.
+struct trace_ring {
+   array<trace_event,trace::ring_size> events;
+   atomic<uint64_t> recorded {0};
+   size_t thread_nr {0};
+};
+
+// Every ring ever made, so that dump can find the rings of threads
+// that have finished.  A finished thread's ring goes on free_rings,
+// keeping its traces until dump or until the next new thread takes it
+// over, so there are never more rings than threads alive at once.
+// The lock is taken only when a thread records its first trace, when
+// it exits, and by dump.
+static mutex rings_lock;
+static vector<unique_ptr<trace_ring>> rings;
+static vector<trace_ring*> free_rings;
+static thread_local trace_ring* my_ring {nullptr};
+
+// Gives a thread's ring back to free_rings when the thread exits.  A
+// trace made after that, by the dtor of some other thread_local, gets
+// a ring of its own that is never reused.
+struct ring_owner {
+   trace_ring* ring {nullptr};
+   ~ring_owner();
+};
+static thread_local bool ring_returned {false};
+static thread_local ring_owner my_owner;
+
+ring_owner::~ring_owner() {
+   ring_returned = true;
+   my_ring = nullptr;
+   if (ring == nullptr) return;
+   lock_guard<mutex> guard (rings_lock);
+   free_rings.push_back (ring);
+}
+
+trace_event& trace::next_event() {
+   if (my_ring == nullptr) {
+      lock_guard<mutex> guard (rings_lock);
+      if (ring_returned) {
+         rings.push_back (make_unique<trace_ring>());
+         my_ring = rings.back().get();
+         my_ring->thread_nr = rings.size() - 1;
+      }else {
+         if (free_rings.empty()) {
+            rings.push_back (make_unique<trace_ring>());
+            rings.back()->thread_nr = rings.size() - 1;
+            free_rings.push_back (rings.back().get());
+         }
+         my_ring = free_rings.back();
+         free_rings.pop_back();
+         my_owner.ring = my_ring;
+      }
+   }
+   uint64_t recorded = my_ring->recorded.load (memory_order_relaxed);
+   my_ring->recorded.store (recorded + 1, memory_order_relaxed);
+   trace_event& event = my_ring->events[recorded % ring_size];
+   event.time = chrono::duration_cast<chrono::nanoseconds> (
+                chrono::steady_clock::now().time_since_epoch()).count();
+   return event;
+}
+
+// Replaces each % in the format with the next argument.
+static void print_message (ostream& out, const trace_event& event) {
+   uint8_t arg = 0;
+   for (const char* format = event.site->format; *format != '\0';
+        ++format) {
+      if (*format != '%' or arg == event.arg_count) {
+         out << *format;
+      }else if (arg == event.text_arg) {
+         out << event.text;
+         ++arg;
+      }else {
+         out << event.args[arg++];
+      }
+   }
+}
+
+// The caller's stream gets back the flags and precision it came with.
+void trace::dump (ostream& out) {
+   lock_guard<mutex> guard (rings_lock);
+   struct held_event {
+      const trace_event* event;
+      size_t thread_nr;
+   };
+   vector<held_event> held;
+   uint64_t dropped = 0;
+   for (const auto& ring: rings) {
+      uint64_t recorded = ring->recorded.load (memory_order_relaxed);
+      uint64_t first = recorded > ring_size ? recorded - ring_size : 0;
+      dropped += first;
+      for (uint64_t count = first; count < recorded; ++count) {
+         held.push_back ({&ring->events[count % ring_size],
+                          ring->thread_nr});
+      }
+   }
+   if (held.empty()) return;
+   stable_sort (held.begin(), held.end(),
+                [](const held_event& left, const held_event& right) {
+                   return left.event->time < right.event->time;
+                });
+   uint64_t start = held.front().event->time;
+   ios_base::fmtflags flags = out.flags();
+   streamsize precision = out.precision();
+   if (dropped > 0) {
+      out << execname() << ": TRACE: " << dropped
+          << " older traces dropped" << endl;
+   }
+   for (const held_event& each: held) {
+      const trace_event& event = *each.event;
+      const trace_site& site = *event.site;
+      out << execname() << ": TRACE(" << site.flag << ") t"
+          << each.thread_nr << " +" << fixed << setprecision (3)
+          << (event.time - start) / 1e3 << "us " << site.file << "["
+          << site.line << "] " << site.func << "() ";
+      print_message (out, event);
+      out << '\n';
+   }
+   out.flush();
+   out.flags (flags);
+   out.precision (precision);
+   for (const auto& ring: rings) {
+      ring->recorded.store (0, memory_order_relaxed);
+   }
+}
+
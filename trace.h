@@ -0,0 +1,137 @@
+// $Id: trace.h,v 1.1 2016-03-19 14:02:10-07 - - $
+// Partner: Darius Sakhapour(dsakhapo@ucsc.edu)
+// Partner: Ryan Wong (rystwong@ucsc.edu)
+
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+using namespace std;
+
+#include "debug.h"
+
+// TRACE_FLAGS -
+//    The debug flags whose traces are compiled in, as a string, or
+//    "@" for all of them.  Build with -DTRACE_FLAGS='""' to compile
+//    every trace out.
+
+#ifndef TRACE_FLAGS
+#define TRACE_FLAGS "@"
+#endif
+
+// trace_site -
+//    Everything about a trace that is fixed at compile time:  its
+//    flag, where it is, and the format of its message.  Each % in the
+//    format is replaced by the next argument.  One per TRACE.
+
+struct trace_site {
+   char flag;
+   const char* file;
+   int line;
+   const char* func;
+   const char* format;
+};
+
+// trace_event -
+//    One trace as recorded:  when, which site, and up to max_args
+//    arguments.  Integers, enums and pointers are kept as 64 bit
+//    values.  At most one argument may be a string, which is copied,
+//    cut to fit, into text, and printed in the place of arg text_arg.
+//    An event fills one cache line.
+
+struct trace_event {
+   static constexpr size_t max_args = 3;
+   static constexpr uint8_t no_text = UINT8_MAX;
+   uint64_t time;
+   const trace_site* site;
+   int64_t args[max_args];
+   uint8_t arg_count;
+   uint8_t text_arg;
+   char text[22];
+   template <typename arg_t>
+   void add (const arg_t& arg) {
+      if constexpr (is_convertible_v<const arg_t&, string_view>) {
+         string_view view = arg;
+         size_t length = min (view.size(), sizeof text - 1);
+         memcpy (text, view.data(), length);
+         text[length] = '\0';
+         text_arg = arg_count++;
+      }else if constexpr (is_pointer_v<arg_t>) {
+         args[arg_count++] = reinterpret_cast<intptr_t> (arg);
+      }else {
+         static_assert (is_integral_v<arg_t> or is_enum_v<arg_t>,
+                        "trace arguments are integers or a string");
+         args[arg_count++] = static_cast<int64_t> (arg);
+      }
+   }
+};
+
+// trace -
+//    A binary replacement for DEBUGF where it is called often.  Each
+//    thread records its traces into a ring buffer of its own, with no
+//    locking and no formatting, and keeps the latest ring_size of
+//    them.  When a thread exits its ring is kept for the next thread
+//    to start, so threads that come and go do not each cost a ring.
+//    Nothing is printed until dump, which merges the rings in time
+//    order, tagging each trace with the number of its ring.  The
+//    categories are the debug flags:  a trace is recorded if its
+//    flag was compiled in by TRACE_FLAGS and is set by -@ at run
+//    time.
+// compiled -
+//    Whether traces for a flag are compiled in.
+// record -
+//    Used by the TRACE macro.  Not to be called by user code.
+// dump -
+//    Prints every trace still held, oldest first, and empties the
+//    rings.  Should not race with threads that are tracing.
+
+class trace {
+   public:
+      static constexpr size_t ring_size = 8192;
+      static constexpr bool compiled (char flag) {
+         for (const char* compiled = TRACE_FLAGS; *compiled != '\0';
+              ++compiled) {
+            if (*compiled == flag or *compiled == '@') return true;
+         }
+         return false;
+      }
+      template <typename... args_t>
+      static void record (const trace_site& site, const args_t&... args) {
+         static_assert (sizeof... (args) <= trace_event::max_args,
+                        "too many trace arguments");
+         trace_event& event = next_event();
+         event.site = &site;
+         event.arg_count = 0;
+         event.text_arg = trace_event::no_text;
+         (event.add (args), ...);
+      }
+      static void dump (ostream& out);
+   private:
+      static trace_event& next_event();
+};
+
+// TRACE -
+//    Records a trace if its flag is compiled in and set.  The first
+//    argument is the flag, the second the format, and the rest are
+//    its arguments.
+//    Example:
+//       TRACE ('i', "inode %, type = %", inode_nr, type);
+
+#define TRACE(FLAG,FORMAT,...) { \
+           if constexpr (trace::compiled (FLAG)) { \
+              if (debugflags::getflag (FLAG)) { \
+                 static const trace_site trace_here { \
+                    FLAG, __FILE__, __LINE__, __func__, FORMAT}; \
+                 trace::record (trace_here, ##__VA_ARGS__); \
+              } \
+           } \
+        }
+
+#endif
+
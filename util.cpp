@@ -9,8 +9,9 @@ using namespace std;
 
 #include "util.h"
 #include "debug.h"
+#include "trace.h"
 
-int exit_status::status = EXIT_SUCCESS;
+atomic<int> exit_status::status {EXIT_SUCCESS};
 static string execname_string;
 
 void exit_status::set (int new_status) {
@@ -56,6 +57,52 @@ wordvec split (const string& line, const string& delimiters) {
    return words;
 }
 
+void split_views (string_view text, const delimiter_table& delimiters,
+                  vector<string_view>& words) {
+   words.clear();
+   size_t size = text.size();
+   size_t end = 0;
+   for (;;) {
+      while (end < size and delimiters (text[end])) ++end;
+      if (end == size) break;
+      size_t start = end;
+      while (end < size and not delimiters (text[end])) ++end;
+      words.push_back (text.substr (start, end - start));
+   }
+}
+
+void split_words (string_view line, vector<string_view>& words) {
+   words.clear();
+   size_t size = line.size();
+   size_t end = 0;
+   for (;;) {
+      while (end < size and blanks (line[end])) ++end;
+      if (end == size) break;
+      char quote = line[end];
+      if (quote == '"' or quote == '\'') {
+         size_t start = end + 1;
+         size_t close = line.find (quote, start);
+         if (close == string_view::npos) close = size;
+         words.push_back (line.substr (start, close - start));
+         end = close == size ? size : close + 1;
+         continue;
+      }
+      size_t start = end;
+      while (end < size and not blanks (line[end])) ++end;
+      words.push_back (line.substr (start, end - start));
+   }
+   TRACE ('u', "% words", words.size());
+}
+
+ostream& operator<< (ostream& out, word_span words) {
+   for (const string_view* word = words.begin(); word != words.end();
+        ++word) {
+      if (word != words.begin()) out << " ";
+      out << *word;
+   }
+   return out;
+}
+
 ostream& complain() {
    exit_status::set (EXIT_FAILURE);
    cerr << execname() << ": ";
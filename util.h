@@ -9,9 +9,12 @@
 #ifndef __UTIL_H__
 #define __UTIL_H__
 
+#include <atomic>
+#include <climits>
 #include <iostream>
 #include <stdexcept>
 #include <string>
+#include <string_view>
 #include <vector>
 using namespace std;
 
@@ -23,6 +26,42 @@ using range_type = pair<iterator,iterator>;
 using wordvec = vector<string>;
 using word_range = range_type<decltype(declval<wordvec>().cbegin())>;
 
+// word_span -
+//    A read-only view of a run of words, each a string_view into the
+//    line it was split from, so handing a command its words copies
+//    two pointers and no text.  Stands in for span<const string_view>.
+// subspan -
+//    The words from offset to the end.
+
+class word_span {
+   private:
+      const string_view* first {nullptr};
+      size_t count {0};
+   public:
+      word_span() = default;
+      word_span (const string_view* first_, size_t count_):
+                 first (first_), count (count_) {}
+      word_span (const vector<string_view>& words):
+                 first (words.data()), count (words.size()) {}
+      size_t size() const {return count;}
+      bool empty() const {return count == 0;}
+      const string_view* begin() const {return first;}
+      const string_view* end() const {return first + count;}
+      const string_view& operator[] (size_t index) const {
+         return first[index];
+      }
+      const string_view& at (size_t index) const {
+         if (index >= count) throw out_of_range ("word_span::at");
+         return first[index];
+      }
+      word_span subspan (size_t offset) const {
+         return offset >= count ? word_span()
+                                : word_span (first + offset, count - offset);
+      }
+};
+
+ostream& operator<< (ostream& out, word_span words);
+
 // setexecname -
 //    Sets the static string to be used as an execname.
 // execname -
@@ -43,11 +82,12 @@ bool want_echo();
 //    A static class for maintaining the exit status.  The default
 //    status is EXIT_SUCCESS (0), but can be set to another value,
 //    such as EXIT_FAILURE (1) to indicate that error messages have
-//    been printed.
+//    been printed.  Atomic, since server sessions may set it from
+//    several threads at once.
 
 class exit_status {
    private:
-      static int status;
+      static atomic<int> status;
    public:
       static void set (int);
       static int get();
@@ -60,6 +100,45 @@ class exit_status {
 
 wordvec split (const string& line, const string& delimiter);
 
+// delimiter_table -
+//    The set of separator bytes, built at compile time, so a split
+//    tests each byte with one load instead of searching a string of
+//    delimiters.  blanks separates the words of a command line, and
+//    slashes the components of a pathname.
+
+class delimiter_table {
+   private:
+      bool separates[UCHAR_MAX + 1] {};
+   public:
+      constexpr delimiter_table (const char* delimiters) {
+         for (; *delimiters != '\0'; ++delimiters) {
+            separates[static_cast<unsigned char> (*delimiters)] = true;
+         }
+      }
+      constexpr bool operator() (char byte) const {
+         return separates[static_cast<unsigned char> (byte)];
+      }
+};
+
+inline constexpr delimiter_table blanks {" \t"};
+inline constexpr delimiter_table slashes {"/"};
+
+// split_views -
+//    Like split, but fills words with views into text, so nothing is
+//    copied and, once words has grown to fit, nothing is allocated.
+//    The views are valid as long as text is.
+// split_words -
+//    Splits a command line at blanks into views the same way, except
+//    that a word starting with a double or single quote runs to the
+//    matching quote and may hold blanks.  The quotes are not part of
+//    the word, nothing is escaped inside them, and a word ends at its
+//    closing quote.  A quote with no match runs to the end of the
+//    line.
+
+void split_views (string_view text, const delimiter_table& delimiters,
+                  vector<string_view>& words);
+void split_words (string_view line, vector<string_view>& words);
+
 // complain -
 //    Used for starting error messages.  Sets the exit status to
 //    EXIT_FAILURE, writes the program name to cerr, and then
@@ -76,7 +155,7 @@ ostream& complain();
 
 template <typename item_t>
 ostream& operator<< (ostream& out, const vector<item_t>& vec) {
-   string space = "";
+   const char* space = "";
    for (const auto& item: vec) {
       out << space << item;
       space = " ";